@@ -0,0 +1,626 @@
+#include "Caos.h"
+#include "SharedMemoryInterface.h"
+#include "Support.h"
+#include <algorithm>
+#include <array>
+#include <cstdio>
+
+// every word of every command, function and condition, from the engines' CAOS documentation.
+// commands with a namespace ("new: simp", "pray agts") are the namespace and each word after it.
+// extra words only make us more forgiving, a missing one turns a good script away, so when unsure leave it in.
+static constexpr std::string_view g_c2eWords =
+// flow
+	"scrp endm rscr iscr inst slow lock unlk wait over stop doif elif else endi reps repe loop untl ever "
+	"enum esee etch epas econ next gsub subr retn call caos ject "
+	"eq ne gt ge lt le and or bt bf "
+// variables
+	"setv sets seta addv subv mulv divv modv negv andv orrv notv absv adds abso "
+	"acos asin atan cos_ sin_ tan_ sqrt ftoi itof stof stoi vtos sins strl subs char lowa uppa "
+	"type avar rand read reaf rean reaq vmjr vmnr game eame mame name gamn eamn namn gnam delg deln dele modu "
+	"_p1_ _p2_ _it_ from ownr targ null pntr norn hhld hand rtar star ttar seee dsee velo "
+// agents
+	"new: simp comp vhcl crea crag newc kill "
+	"abba alph anim anms attr base bhvr carr cata cati cato catx clac clik core dcor disq drop "
+	"fltx flty fmly frat gait gall gnus held hght iitt imsk mesg writ wrt+ mira mows mthx mthy ncls nohh "
+	"pcls plne pose puhl pupt show spcs tick tint tino tcor totl touc tran twin ucln visi wdth wild paus shad "
+	"emit heap plmd plmu unid rotn tntc tnto ufos rnge "
+// compound agents
+	"fcus frmt grpl grpv npgs page part pnxt ptxt pat: butt cmra dull fixd grph move text "
+// brain
+	"brn: dmpb dmpd dmpl dmpn dmpt setd setl setn sett adin doin "
+// camera
+	"bkgd brmi cmrp cmrt cmrx cmry frsh line loft meta snap snax trck wdow wndb wndh wndl wndr wndt wndw zoom scam "
+// creatures
+	"ages appr aslp attn body born bvar byit cage calg chem dead decn dftx dfty dirn done drea driv drv! "
+	"expr face forf hair injr insp like limb loci ltcy mate mind motr mvft nude ordr shou sign tact "
+	"orgf orgi orgn sayn seen soul spnl stim sway tage trig uftx ufty uncs urge vocb walk wear zomb "
+// debug
+	"dbg: dbg# dbga asrt cpro flsh html outs outv outx paws play poll prof tack tock wtik "
+	"agnt bang head help mann memx apro code codf codg codo codp cods ins# stpt "
+// files
+	"file glob iclo iope jdel oclo oflu oope innf inni innl inok webb fvwm "
+// genetics
+	"gene clon cros load gtos mtoa mtoc "
+// history
+	"hist coun date evnt find finr foto gend mon1 mon2 mute prev rtim sean utxt vari wipe wnam wuid wvet ooww "
+// input
+	"hotp hots keyd mopx mopy mous pure "
+// map
+	"addb addm addr altr bkds cacl calc delm delr dmap doca door emid erid gmap grap grid hirp link lorp "
+	"mapd mapk mloc perm prop rate rloc room rtyp torx tory "
+// motion
+	"accg adel aero angl avel elas fall fdel fric fvel movs movx movy mvby mvsf mvto obst "
+	"posb posl posr post posx posy relx rely sdel spin tmvb tmvf tmvt velx vely wall flto frel "
+// ports
+	"prt: frma inew itot izap join krak onew otot ozap send "
+// resources
+	"pray agti agts back deps expo fore garb impo injt make refr test "
+// scripts
+	"gids root scrx sorc sorq "
+// sounds
+	"fade mclr midi mmsc rmsc sezz sndc snde sndl sndq stpc strk voic vois volm "
+	"_cd_ ejct frqh frql frqm init shut "
+// time
+	"buzz dayt etik mont msec pace race rtif scol seav time wolf wpau year "
+// vehicles
+	"cabb cabl cabn cabp cabr cabt cabv cabw dpas gpas rpas spas "
+// world
+	"delw nwld pswd quit rgam save wnti wrld wtnt ruso "
+// network
+	"net: errr hear host make pass rawe stat ulin unik user what who whod whof whon whoz wrtp ";
+
+// creatures 1 and 2 share most of this; they talk to us over dde.
+static constexpr std::string_view g_ddeWords =
+// flow
+	"scrp endm rscr inst slow wait over stop doif else endi reps repe loop untl ever "
+	"enum esee etch next gsub subr retn "
+	"eq ne gt ge lt le and or bt bf "
+// variables
+	"setv addv subv mulv divv modv negv andv orrv rndv "
+	"_p1_ _p2_ _it_ from ownr targ pntr norn totl "
+// objects
+	"new: simp comp vhcl crea bkbd cbtn kill part pose anim base mesg writ shou sign tact stim "
+	"obst mvto mvby posl post posr posb limt limr limb liml velx vely accg aero rest bhvr attr actv "
+	"cabn spas gpas dpas xvec yvec carr drop touc wdth hght fmly gnus spcs clas cls2 tick "
+	"sndc snde sndl sndq stpc edit "
+// creatures
+	"chem driv drv! dead aslp zomb drea uncs mate like done dirn face ltcy mvft appr walk injr trig body "
+	"bvar byit attn decn expr orgn ordr sayn say$ sayv sway urge cage aged objp "
+// system
+	"sys: camt cmra wtop dde: getb puts putv negg pict lobe panc ceye putb monk cnam "
+	"dbg: outs outv bbd: emit vocb word ";
+
+// c2 on top of c1.
+static constexpr std::string_view g_c2Words =
+	"rms# rmno room rtyp door altr lite hotl temp pres wndx wndy rain seas sean year time "
+	"dsee esee rndr orgf orgi brn: hist cmrp ";
+
+// words that only look at the world: output, flow, conditions and functions that aren't also commands.
+// the other way round from above, a word missing here just means the script isn't cached, so when unsure leave it out.
+// targ is in because it only changes the script's own vm; rand isn't, the answer has to be the same every time.
+// output is only to the reply: dbg: writes the debug log (which clients get ws lines from) and dde: puts* the
+// dde output buffer, running those twice isn't the same as running them once.
+static constexpr std::string_view g_readOnlyWords =
+	"outs outv outx "
+	"doif elif else endi enum esee etch epas next reps repe loop untl ever targ "
+	"eq ne gt ge lt le and or bt bf "
+	"_p1_ _p2_ _it_ from ownr null pntr hhld "
+	"totl gnam game eame modu unid vmjr vmnr wtik rtim pace dayt msec sean year "
+	"posx posy posl post posr posb wdth hght fmly gnus spcs "
+	"vtos stoi stof strl subs lowa uppa sins ftoi itof sqrt "
+	"gtos mtoa mtoc hist coun date find finr gend mon1 mon2 vari wvet cage wnam wuid ";
+
+// "abcd" as a number, lower case; 0 if it can't be a keyword (all of them fit in 4 bytes).
+static constexpr uint32_t Pack(std::string_view word)
+{
+	if(word.empty() || word.size() > 4)
+		return 0;
+
+	uint32_t key = 0;
+
+	for(size_t i = 0; i < word.size(); ++i)
+	{
+		uint8_t c = uint8_t(word[i]);
+
+		if('A' <= c && c <= 'Z')
+			c |= 0x20;
+
+		key |= uint32_t(c) << (i * 8);
+	}
+
+	return key;
+}
+
+static constexpr uint32_t Mix(uint32_t key)
+{
+	uint32_t h = key * 0x85EBCA6Bu;
+	h ^= h >> 13;
+	h *= 0xC2B2AE35u;
+	h ^= h >> 16;
+	return h;
+}
+
+// hash and displace: each key's bucket has a seed that sends every key in the bucket to an empty slot,
+// so a lookup is one hash and one compare.
+template<size_t SLOTS, size_t BUCKETS>
+struct PerfectHash
+{
+	static_assert((SLOTS & (SLOTS - 1)) == 0 && (BUCKETS & (BUCKETS - 1)) == 0);
+
+	std::array<uint32_t, SLOTS> keys{};
+	std::array<uint16_t, BUCKETS> seeds{};
+	bool built{};
+
+	static constexpr size_t Bucket(uint32_t hash) { return hash & (BUCKETS - 1); }
+// the step is odd so every seed lands somewhere different.
+	static constexpr size_t Slot(uint32_t hash, uint32_t seed) { return ((hash >> 8) + seed * ((hash >> 19) | 1)) & (SLOTS - 1); }
+
+	constexpr bool contains(uint32_t key) const
+	{
+		auto hash = Mix(key);
+		return key && keys[Slot(hash, seeds[Bucket(hash)])] == key;
+	}
+};
+
+enum
+{
+	MAX_BUCKET = 16,
+	MAX_SEED = 0xFFFF,
+};
+
+template<size_t SLOTS, size_t BUCKETS>
+static constexpr PerfectHash<SLOTS, BUCKETS> BuildHash(std::array<std::string_view, 2> lists)
+{
+	PerfectHash<SLOTS, BUCKETS> r{};
+
+// which keys go in which bucket, the same word listed twice only counts once.
+	std::array<std::array<uint32_t, MAX_BUCKET>, BUCKETS> buckets{};
+	std::array<size_t, BUCKETS> sizes{};
+
+	for(auto words : lists)
+	{
+		for(size_t i = 0; i < words.size(); )
+		{
+			size_t end = i;
+
+			while(end < words.size() && words[end] != ' ')
+				++end;
+
+			if(end == i)
+			{
+				++i;
+				continue;
+			}
+
+			auto key = Pack(words.substr(i, end - i));
+			i = end;
+
+			if(key == 0)
+				return r;
+
+			auto b = r.Bucket(Mix(key));
+			bool seen = false;
+
+			for(size_t j = 0; j < sizes[b]; ++j)
+				seen = seen || buckets[b][j] == key;
+
+			if(seen)
+				continue;
+
+			if(sizes[b] == MAX_BUCKET)
+				return r;
+
+			buckets[b][sizes[b]++] = key;
+		}
+	}
+
+// biggest buckets first, while there is the most room.
+	for(size_t size = MAX_BUCKET; size > 0; --size)
+	{
+		for(size_t b = 0; b < BUCKETS; ++b)
+		{
+			if(sizes[b] != size)
+				continue;
+
+			uint32_t hashes[MAX_BUCKET]{};
+
+			for(size_t j = 0; j < size; ++j)
+				hashes[j] = Mix(buckets[b][j]);
+
+			uint32_t seed = 0;
+
+			for(; seed < MAX_SEED; ++seed)
+			{
+				bool fits = true;
+
+				for(size_t j = 0; fits && j < size; ++j)
+				{
+					auto slot = r.Slot(hashes[j], seed);
+					fits = r.keys[slot] == 0;
+
+				// two keys from this bucket landing on each other.
+					for(size_t k = 0; fits && k < j; ++k)
+						fits = r.Slot(hashes[k], seed) != slot;
+				}
+
+				if(fits)
+					break;
+			}
+
+			if(seed == MAX_SEED)
+				return r;
+
+			r.seeds[b] = uint16_t(seed);
+
+			for(size_t j = 0; j < size; ++j)
+				r.keys[r.Slot(hashes[j], seed)] = buckets[b][j];
+		}
+	}
+
+	r.built = true;
+	return r;
+}
+
+static constexpr auto g_c1Keywords = BuildHash<512, 128>({ g_ddeWords, {} });
+static constexpr auto g_c2Keywords = BuildHash<512, 128>({ g_ddeWords, g_c2Words });
+static constexpr auto g_c2eKeywords = BuildHash<1024, 256>({ g_c2eWords, {} });
+
+static constexpr auto g_readOnlyKeywords = BuildHash<256, 64>({ g_readOnlyWords, {} });
+
+static_assert(g_c1Keywords.built && g_c2Keywords.built && g_c2eKeywords.built && g_readOnlyKeywords.built, "keyword table couldn't be hashed, make it bigger");
+static_assert(g_c2eKeywords.contains(Pack("OUTV")) && g_c2eKeywords.contains(Pack("new:")) && !g_c2eKeywords.contains(Pack("outz")));
+static_assert(!g_readOnlyKeywords.contains(Pack("dbg:")) && !g_readOnlyKeywords.contains(Pack("dde:")) && !g_readOnlyKeywords.contains(Pack("putv")));
+
+Caos::Dialect Caos::GetDialect(SharedMemoryInterface const& engine)
+{
+	if(engine.isCreatures1())
+		return Dialect::C1;
+
+	if(engine.isCreatures2())
+		return Dialect::C2;
+
+	return Dialect::C2E;
+}
+
+const char * Caos::GetName(Dialect dialect)
+{
+	switch(dialect)
+	{
+	case Dialect::C1:	return "c1";
+	case Dialect::C2:	return "c2";
+	case Dialect::C2E:	return "c2e";
+	default:			return "unknown";
+	}
+}
+
+bool Caos::IsKeyword(Dialect dialect, std::string_view word)
+{
+	auto key = Pack(word);
+
+	switch(dialect)
+	{
+	case Dialect::C1:	return g_c1Keywords.contains(key);
+	case Dialect::C2:	return g_c2Keywords.contains(key);
+	case Dialect::C2E:	return g_c2eKeywords.contains(key);
+	default:			return false;
+	}
+}
+
+static bool IsDigit(char c) { return '0' <= c && c <= '9'; }
+
+// va00-va99, ov00-ov99, mv00-mv99, and var0-var9, obv0-obv9 on the older engines.
+static bool IsVariable(std::string_view word)
+{
+	if(word.size() != 4)
+		return false;
+
+	auto lower = [&](size_t i) { return char(word[i] | 0x20); };
+
+	if(IsDigit(word[2]) && IsDigit(word[3]))
+	{
+		return (lower(0) == 'v' && lower(1) == 'a')
+			|| (lower(0) == 'o' && lower(1) == 'v')
+			|| (lower(0) == 'm' && lower(1) == 'v');
+	}
+
+	if(IsDigit(word[3]))
+	{
+		return (lower(0) == 'v' && lower(1) == 'a' && lower(2) == 'r')
+			|| (lower(0) == 'o' && lower(1) == 'b' && lower(2) == 'v');
+	}
+
+	return false;
+}
+
+static bool IsSeparator(char c)
+{
+	return (unsigned char)c < 0x80 && (isWhitespace(c) || c == ',');
+}
+
+bool Caos::Tokenizer::next(Token & token)
+{
+	auto in = _script.data();
+	auto length = _script.size();
+
+	while(_pos < length && IsSeparator(in[_pos]))
+		++_pos;
+
+	if(_pos == length)
+		return false;
+
+	size_t start = _pos;
+	char c = in[_pos];
+	bool c1 = _dialect != Dialect::C2E;
+
+	auto finish = [&](Type type)
+	{
+		token.type = type;
+		token.text = _script.substr(start, _pos - start);
+		token.offset = start;
+		return true;
+	};
+
+// to the end of the line.
+	if(c == '*')
+	{
+		while(_pos < length && in[_pos] != '\n')
+			++_pos;
+
+		return finish(Type::Comment);
+	}
+
+	if(c == '"' && c1 == false)
+	{
+		for(++_pos; _pos < length; ++_pos)
+		{
+			if(in[_pos] == '\\')
+				++_pos;
+			else if(in[_pos] == '"')
+				return ++_pos, finish(Type::String);
+		}
+
+		_pos = length;
+		return finish(Type::Error);
+	}
+
+// a string on the old engines, bytes (or animation frames) on c2e.
+	if(c == '[')
+	{
+		for(++_pos; _pos < length; ++_pos)
+		{
+			if(in[_pos] == ']')
+				return ++_pos, finish(c1? Type::String : Type::ByteString);
+		}
+
+		return finish(Type::Error);
+	}
+
+// a character, which can be a space or a comma so it can't be left to the loop below.
+	if(c == '\'' && _pos + 2 < length && in[_pos + 2] == '\'')
+	{
+		_pos += 3;
+		return finish(Type::Number);
+	}
+
+	while(_pos < length && IsSeparator(in[_pos]) == false)
+		++_pos;
+
+	auto word = _script.substr(start, _pos - start);
+
+	if(word == "=" || word == "<>" || word == "<" || word == ">" || word == "<=" || word == ">=")
+		return finish(Type::Operator);
+
+// 12, -3, 1.5, .5 or %1010 (binary).
+	if(IsDigit(c)
+	|| ((c == '-' || c == '.') && word.size() > 1 && (IsDigit(word[1]) || word[1] == '.'))
+	|| (c == '%' && word.size() > 1))
+		return finish(Type::Number);
+
+	if(IsVariable(word))
+		return finish(Type::Variable);
+
+	return finish(Type::Word);
+}
+
+size_t Caos::Tokenizer::GetLine(size_t offset) const
+{
+	size_t line = 1;
+
+	for(size_t i = 0; i < offset && i < _script.size(); ++i)
+		line += _script[i] == '\n';
+
+	return line;
+}
+
+// leading zeros of the whole part and trailing zeros of the fraction, anything odd is left alone.
+static void AppendNumber(std::string & out, std::string_view number)
+{
+	if(number[0] == '\'')
+	{
+		out += number;
+		return;
+	}
+
+	if(number[0] == '%')
+	{
+		auto digits = number.substr(1);
+
+		while(digits.size() > 1 && digits[0] == '0')
+			digits.remove_prefix(1);
+
+		out += '%';
+		out += digits;
+		return;
+	}
+
+	size_t i = number[0] == '-';
+	size_t point = number.find('.');
+	auto whole = number.substr(i, point == std::string_view::npos? std::string_view::npos : point - i);
+	auto fraction = point == std::string_view::npos? std::string_view{} : number.substr(point + 1);
+
+	for(auto part : { whole, fraction })
+	{
+		for(char c : part)
+		{
+			if(IsDigit(c) == false)
+			{
+				out += number;
+				return;
+			}
+		}
+	}
+
+	while(whole.size() > 1 && whole[0] == '0')
+		whole.remove_prefix(1);
+
+	while(fraction.size() > 1 && fraction.back() == '0')
+		fraction.remove_suffix(1);
+
+	out += number.substr(0, i);
+	out += whole;
+
+	if(point != std::string_view::npos)
+	{
+		out += '.';
+		out += fraction;
+	}
+}
+
+size_t Caos::Minify(std::string & out, std::string_view script, Dialect dialect)
+{
+	Tokenizer tokenizer(script, dialect);
+	Token token;
+	size_t end = 0;
+
+	out.clear();
+
+	while(tokenizer.next(token))
+	{
+		if(token.type == Type::Comment)
+			continue;
+
+	// only where there was something to begin with, "abc"def stays as it is.
+		if(out.size() && token.offset > end)
+			out += ' ';
+
+		end = token.offset + token.text.size();
+
+		if(token.type == Type::Number)
+			AppendNumber(out, token.text);
+		else
+			out += token.text;
+	}
+
+	return script.size() - out.size();
+}
+
+bool Caos::IsReadOnly(std::string_view script, Dialect dialect)
+{
+	Tokenizer tokenizer(script, dialect);
+	Token token;
+	bool any = false;
+
+	while(tokenizer.next(token))
+	{
+		if(token.type == Type::Error)
+			return false;
+
+		if(token.type != Type::Word)
+			continue;
+
+		if(IsKeyword(dialect, token.text) == false || g_readOnlyKeywords.contains(Pack(token.text)) == false)
+			return false;
+
+		any = true;
+	}
+
+	return any;
+}
+
+bool Caos::IsErrorReply(std::string_view reply)
+{
+// what the engines (and openc2e) start an error with, lower case.
+	static constexpr std::string_view prefixes[] = { "error", "### exception", "syntax error", "runtime error" };
+
+	reply = TrimWhitespace(reply);
+
+	for(auto prefix : prefixes)
+	{
+		if(reply.size() < prefix.size())
+			continue;
+
+		bool match = true;
+
+		for(size_t i = 0; match && i < prefix.size(); ++i)
+			match = char(reply[i] | 0x20) == prefix[i];
+
+		if(match)
+			return true;
+	}
+
+	return false;
+}
+
+std::string Caos::Validate(std::string_view script, Dialect dialect)
+{
+	Tokenizer tokenizer(script, dialect);
+	Token token;
+
+	bool inScript = false;
+	bool isLabel = false;
+	char buffer[256];
+
+	auto error = [&](const char * what)
+	{
+		snprintf(buffer, sizeof(buffer), "%s (line %zu): %.*s", what, tokenizer.GetLine(token.offset), (int)std::min<size_t>(token.text.size(), 64), token.text.data());
+		return std::string(buffer);
+	};
+
+	while(tokenizer.next(token))
+	{
+		if(token.type == Type::Error)
+			return error("Error: string never ends");
+
+		if(token.type != Type::Word)
+		{
+			isLabel = false;
+			continue;
+		}
+
+	// whatever comes after subr/gsub is the name of a subroutine, anything goes.
+		if(isLabel)
+		{
+			isLabel = false;
+			continue;
+		}
+
+		auto key = Pack(token.text);
+
+		if(key == Pack("scrp"))
+		{
+			if(inScript)
+				return error("Error: scrp inside a script, is an endm missing?");
+
+			inScript = true;
+		}
+		else if(key == Pack("endm"))
+		{
+			if(inScript == false)
+				return error("Error: endm without a scrp");
+
+			inScript = false;
+		}
+		else if(key == Pack("subr") || key == Pack("gsub"))
+		{
+			isLabel = true;
+		}
+	}
+
+	if(inScript)
+	{
+		snprintf(buffer, sizeof(buffer), "Error: scrp without an endm (line %zu)", tokenizer.GetLine(script.size()));
+		return buffer;
+	}
+
+	return {};
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+class SharedMemoryInterface;
+
+// just enough of CAOS to look at a script before the engine does.
+// - the tokenizer splits a script up without copying it, tokens are views of the text.
+// - every dialect has a table of the words it knows, built (and perfectly hashed) at compile time.
+// - Validate catches what would otherwise cost a round trip to find out (or crash c1):
+//   scrp without endm and strings that never end. it doesn't look words up, the tables
+//   aren't complete and token arguments on c1/c2 (snde, tokn, new: simp) are bare words too.
+class Caos
+{
+public:
+	enum class Dialect
+	{
+		C1,
+		C2,
+		C2E,
+	};
+
+	enum class Type
+	{
+		Word,
+		Variable,
+		Number,
+		String,
+		ByteString,
+		Operator,
+		Comment,
+		// a string or byte string that runs off the end of the script.
+		Error,
+	};
+
+struct Token;
+class Tokenizer;
+
+	static Dialect GetDialect(SharedMemoryInterface const&);
+	static const char * GetName(Dialect);
+
+// command, function or any other word of a command ("new:", "simp"), case doesn't matter.
+	static bool IsKeyword(Dialect, std::string_view word);
+
+// the engine says a script failed as part of its reply, the same as it says anything else.
+// true if reply looks like that, or like one Validate turned away (they all start "Error:").
+	static bool IsErrorReply(std::string_view reply);
+
+// empty if the script looks fine, otherwise what is wrong and where.
+	static std::string Validate(std::string_view script, Dialect);
+
+// nothing in the script can change the world, so running it twice gives the same answer
+// (as long as nothing else happened in between). unknown words count as changing it.
+	static bool IsReadOnly(std::string_view script, Dialect);
+
+// the same script in fewer bytes: comments dropped, one space between tokens and numbers
+// without leading or trailing zeros (1.0 stays a float). script must have passed Validate.
+// out is overwritten, its buffer reused; returns how many bytes were saved.
+	static size_t Minify(std::string & out, std::string_view script, Dialect);
+};
+
+struct Caos::Token
+{
+	Type type{};
+	std::string_view text;
+	size_t offset{};
+};
+
+class Caos::Tokenizer
+{
+public:
+	Tokenizer(std::string_view script, Dialect dialect) : _script(script), _dialect(dialect) {}
+
+// false once there's nothing left.
+	bool next(Token & token);
+
+// 1 based, for error messages.
+	size_t GetLine(size_t offset) const;
+
+private:
+	std::string_view _script;
+	Dialect _dialect;
+	size_t _pos{};
+};
@@ -0,0 +1,364 @@
+#include "Cp1252.h"
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#define CP1252_SSE2 1
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// what 0x80-0xFF mean, 0 where cp1252 leaves a hole.
+static constexpr uint16_t g_toUnicode[128] =
+{
+	0x20AC, 0,      0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021, 0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0,      0x017D, 0,
+	0,      0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014, 0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0,      0x017E, 0x0178,
+// the rest is latin-1.
+	0x00A0, 0x00A1, 0x00A2, 0x00A3, 0x00A4, 0x00A5, 0x00A6, 0x00A7, 0x00A8, 0x00A9, 0x00AA, 0x00AB, 0x00AC, 0x00AD, 0x00AE, 0x00AF,
+	0x00B0, 0x00B1, 0x00B2, 0x00B3, 0x00B4, 0x00B5, 0x00B6, 0x00B7, 0x00B8, 0x00B9, 0x00BA, 0x00BB, 0x00BC, 0x00BD, 0x00BE, 0x00BF,
+	0x00C0, 0x00C1, 0x00C2, 0x00C3, 0x00C4, 0x00C5, 0x00C6, 0x00C7, 0x00C8, 0x00C9, 0x00CA, 0x00CB, 0x00CC, 0x00CD, 0x00CE, 0x00CF,
+	0x00D0, 0x00D1, 0x00D2, 0x00D3, 0x00D4, 0x00D5, 0x00D6, 0x00D7, 0x00D8, 0x00D9, 0x00DA, 0x00DB, 0x00DC, 0x00DD, 0x00DE, 0x00DF,
+	0x00E0, 0x00E1, 0x00E2, 0x00E3, 0x00E4, 0x00E5, 0x00E6, 0x00E7, 0x00E8, 0x00E9, 0x00EA, 0x00EB, 0x00EC, 0x00ED, 0x00EE, 0x00EF,
+	0x00F0, 0x00F1, 0x00F2, 0x00F3, 0x00F4, 0x00F5, 0x00F6, 0x00F7, 0x00F8, 0x00F9, 0x00FA, 0x00FB, 0x00FC, 0x00FD, 0x00FE, 0x00FF,
+};
+
+// each high byte already encoded, always written as 4 bytes then the output advances by length.
+struct Utf8Sequence
+{
+	char bytes[4];
+	uint8_t length;
+};
+
+static constexpr std::array<Utf8Sequence, 128> g_toUtf8 = []()
+{
+	std::array<Utf8Sequence, 128> r{};
+
+	for(int i = 0; i < 128; ++i)
+	{
+		uint32_t codepoint = g_toUnicode[i];
+		auto & seq = r[i];
+
+		if(codepoint == 0)
+		{
+			seq.bytes[0] = '?';
+			seq.length = 1;
+		}
+		else if(codepoint <= 0x7FF)
+		{
+			seq.bytes[0] = char(0xC0 | (codepoint >> 6));
+			seq.bytes[1] = char(0x80 | (codepoint & 0x3F));
+			seq.length = 2;
+		}
+		else
+		{
+			seq.bytes[0] = char(0xE0 | (codepoint >> 12));
+			seq.bytes[1] = char(0x80 | ((codepoint >> 6) & 0x3F));
+			seq.bytes[2] = char(0x80 | (codepoint & 0x3F));
+			seq.length = 3;
+		}
+	}
+
+	return r;
+}();
+
+// the reverse, cp1252's extra characters all live in one of these two ranges.
+enum
+{
+	LATIN_END = 0x300,
+	PUNCTUATION_BEGIN = 0x2000,
+	PUNCTUATION_END = 0x2130,
+};
+
+struct FromUnicode
+{
+	uint8_t latin[LATIN_END];
+	uint8_t punctuation[PUNCTUATION_END - PUNCTUATION_BEGIN];
+};
+
+static constexpr FromUnicode g_fromUnicode = []()
+{
+	FromUnicode r{};
+
+	for(int i = 0; i < 128; ++i)
+	{
+		uint32_t codepoint = g_toUnicode[i];
+
+		if(codepoint == 0)
+			continue;
+
+		if(codepoint < LATIN_END)
+			r.latin[codepoint] = uint8_t(0x80 + i);
+		else
+			r.punctuation[codepoint - PUNCTUATION_BEGIN] = uint8_t(0x80 + i);
+	}
+
+	return r;
+}();
+
+static inline char EncodeCodepoint(uint32_t codepoint)
+{
+	uint8_t c = 0;
+
+	if(codepoint < LATIN_END)
+		c = g_fromUnicode.latin[codepoint];
+	else if(PUNCTUATION_BEGIN <= codepoint && codepoint < PUNCTUATION_END)
+		c = g_fromUnicode.punctuation[codepoint - PUNCTUATION_BEGIN];
+
+	return c? char(c) : '?';
+}
+
+static inline int CountTrailingZeros(uint32_t mask)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return int(index);
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+// copies bytes from in to out until one that isn't plain ascii (high bit set, or CR),
+// returns how many were copied. may write up to CP1252_SLACK bytes past that.
+size_t CopyAscii(char * out, const char * in, size_t length)
+{
+	size_t i = 0;
+
+#ifdef __AVX2__
+	const __m256i cr32 = _mm256_set1_epi8('\r');
+
+	for(; i + 32 <= length; i += 32)
+	{
+		__m256i block = _mm256_loadu_si256((__m256i const*)(in + i));
+		_mm256_storeu_si256((__m256i*)(out + i), block);
+
+		uint32_t mask = uint32_t(_mm256_movemask_epi8(block)) | uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, cr32)));
+
+		if(mask)
+			return i + CountTrailingZeros(mask);
+	}
+#endif
+
+#ifdef CP1252_SSE2
+	const __m128i cr16 = _mm_set1_epi8('\r');
+
+	for(; i + 16 <= length; i += 16)
+	{
+		__m128i block = _mm_loadu_si128((__m128i const*)(in + i));
+		_mm_storeu_si128((__m128i*)(out + i), block);
+
+		uint32_t mask = uint32_t(_mm_movemask_epi8(block)) | uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(block, cr16)));
+
+		if(mask)
+			return i + CountTrailingZeros(mask);
+	}
+#else
+	for(; i + 8 <= length; i += 8)
+	{
+		uint64_t block;
+		memcpy(&block, in + i, 8);
+		memcpy(out + i, &block, 8);
+
+	// high bits, or a byte that is exactly CR.
+		uint64_t cr = block ^ 0x0D0D0D0D0D0D0D0Dull;
+		uint64_t zero = (cr - 0x0101010101010101ull) & ~cr & 0x8080808080808080ull;
+
+		if((block & 0x8080808080808080ull) | zero)
+			break;
+	}
+#endif
+
+	for(; i < length; ++i)
+	{
+		unsigned char c = in[i];
+
+		if(c >= 0x80 || c == '\r')
+			break;
+
+		out[i] = char(c);
+	}
+
+	return i;
+}
+
+// same test as CopyAscii without the copy, so it never touches memory past the end.
+size_t FindNonAscii(const char * in, size_t length)
+{
+	size_t i = 0;
+
+#ifdef __AVX2__
+	const __m256i cr32 = _mm256_set1_epi8('\r');
+
+	for(; i + 32 <= length; i += 32)
+	{
+		__m256i block = _mm256_loadu_si256((__m256i const*)(in + i));
+		uint32_t mask = uint32_t(_mm256_movemask_epi8(block)) | uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, cr32)));
+
+		if(mask)
+			return i + CountTrailingZeros(mask);
+	}
+#endif
+
+#ifdef CP1252_SSE2
+	const __m128i cr16 = _mm_set1_epi8('\r');
+
+// most replies are short, four blocks at a time until the end is near.
+	for(; i + 64 <= length; i += 64)
+	{
+		__m128i a = _mm_loadu_si128((__m128i const*)(in + i));
+		__m128i b = _mm_loadu_si128((__m128i const*)(in + i + 16));
+		__m128i c = _mm_loadu_si128((__m128i const*)(in + i + 32));
+		__m128i d = _mm_loadu_si128((__m128i const*)(in + i + 48));
+
+		__m128i high = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+		__m128i cr = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(a, cr16), _mm_cmpeq_epi8(b, cr16)),
+			_mm_or_si128(_mm_cmpeq_epi8(c, cr16), _mm_cmpeq_epi8(d, cr16)));
+
+		if(_mm_movemask_epi8(_mm_or_si128(high, cr)))
+			break;
+	}
+
+	for(; i + 16 <= length; i += 16)
+	{
+		__m128i block = _mm_loadu_si128((__m128i const*)(in + i));
+		uint32_t mask = uint32_t(_mm_movemask_epi8(block)) | uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(block, cr16)));
+
+		if(mask)
+			return i + CountTrailingZeros(mask);
+	}
+#else
+	for(; i + 8 <= length; i += 8)
+	{
+		uint64_t block;
+		memcpy(&block, in + i, 8);
+
+		uint64_t cr = block ^ 0x0D0D0D0D0D0D0D0Dull;
+		uint64_t zero = (cr - 0x0101010101010101ull) & ~cr & 0x8080808080808080ull;
+
+		if((block & 0x8080808080808080ull) | zero)
+			break;
+	}
+#endif
+
+	for(; i < length; ++i)
+	{
+		unsigned char c = in[i];
+
+		if(c >= 0x80 || c == '\r')
+			break;
+	}
+
+	return i;
+}
+
+size_t Utf8FromCp1252(char * out, std::string_view in)
+{
+	const char * src = in.data();
+	size_t length = in.size();
+	size_t i = 0;
+	char * dst = out;
+
+	while(i < length)
+	{
+		auto run = CopyAscii(dst, src + i, length - i);
+		dst += run;
+		i += run;
+
+		if(i == length)
+			break;
+
+		unsigned char c = src[i++];
+
+		if(c == '\r')
+			continue;
+
+		auto & seq = g_toUtf8[c - 0x80];
+		memcpy(dst, seq.bytes, 4);
+		dst += seq.length;
+	}
+
+	return dst - out;
+}
+
+void Utf8FromCp1252Stream::write(std::string & out, std::string_view in)
+{
+	auto clean = FindNonAscii(in.data(), in.size());
+
+	if(clean == in.size())
+	{
+		out.append(in);
+		return;
+	}
+
+	isAscii = false;
+
+	auto used = out.size();
+	out.resize(used + clean + Utf8FromCp1252Capacity(in.size() - clean));
+	memcpy(out.data() + used, in.data(), clean);
+	used += clean;
+	used += Utf8FromCp1252(out.data() + used, in.substr(clean));
+	out.resize(used);
+}
+
+char Cp1252FromUtf8Sequence(const unsigned char * in, size_t available, size_t & length)
+{
+	auto continuation = [&](size_t j) { return j < available && (in[j] & 0xC0) == 0x80; };
+
+	unsigned char c = in[0];
+
+// anything malformed is one '?' per byte we can't make sense of.
+	if(0xC2 <= c && c <= 0xDF && continuation(1))
+	{
+		length = 2;
+		return EncodeCodepoint(((c & 0x1F) << 6) | (in[1] & 0x3F));
+	}
+
+	if(0xE0 <= c && c <= 0xEF && continuation(1) && continuation(2))
+	{
+		length = 3;
+		return EncodeCodepoint(((c & 0x0F) << 12) | ((in[1] & 0x3F) << 6) | (in[2] & 0x3F));
+	}
+
+// nothing out here is in cp1252.
+	if(0xF0 <= c && c <= 0xF4 && continuation(1) && continuation(2) && continuation(3))
+		length = 4;
+	else
+		length = 1;
+
+	return '?';
+}
+
+size_t Cp1252FromUtf8(char * out, std::string_view in)
+{
+	auto src = (const unsigned char *)in.data();
+	size_t length = in.size();
+	size_t i = 0;
+	char * dst = out;
+
+	while(i < length)
+	{
+		auto run = CopyAscii(dst, (const char*)src + i, length - i);
+		dst += run;
+		i += run;
+
+		if(i == length)
+			break;
+
+		if(src[i] == '\r')
+		{
+			++i;
+			continue;
+		}
+
+		size_t used;
+		*dst++ = Cp1252FromUtf8Sequence(src + i, length - i, used);
+		i += used;
+	}
+
+	return dst - out;
+}
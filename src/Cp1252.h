@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// cp1252 (what the engines speak) to and from utf8 (what webapps speak).
+// - CR is dropped both ways, neither side wants it.
+// - anything the other side can't represent becomes '?'.
+// - runs of plain ascii are copied a block at a time, out must have room for the
+//   worst case plus slack (use the Capacity functions); returns bytes written.
+size_t Utf8FromCp1252(char * out, std::string_view in);
+size_t Cp1252FromUtf8(char * out, std::string_view in);
+
+// where the first byte that isn't plain ascii (high bit set, or CR) is, length if there isn't one.
+size_t FindNonAscii(const char * in, size_t length);
+
+// the pieces the above are made of, for code that has more to do per character.
+// copies the run of plain ascii at the start of in to out, returns its length.
+size_t CopyAscii(char * out, const char * in, size_t length);
+// decodes the sequence starting at in[0] (which must not be ascii), sets length to how much it used.
+char Cp1252FromUtf8Sequence(const unsigned char * in, size_t available, size_t & length);
+
+enum { CP1252_SLACK = 32 };
+
+// Utf8FromCp1252 for text that turns up a block at a time (a reply coming off a socket),
+// so it can be converted as it arrives instead of all at once at the end.
+// cp1252 is a byte per character and CR is dropped wherever it lands, so a block never
+// ends part way through anything; all that carries over is whether it has all been ascii.
+struct Utf8FromCp1252Stream
+{
+// converts in and appends it to out.
+	void write(std::string & out, std::string_view in);
+
+	bool isAscii{true};
+};
+
+constexpr size_t Utf8FromCp1252Capacity(size_t length) { return length * 3 + CP1252_SLACK; }
+constexpr size_t Cp1252FromUtf8Capacity(size_t length) { return length + CP1252_SLACK; }
@@ -0,0 +1,146 @@
+#include "DebugLine.h"
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#define DEBUGLINE_SSE2 1
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// "[protocol]" then maybe ":message", what's left of the line after the address.
+static bool ParseRoute(std::string_view rest, DebugLine & line)
+{
+	if(rest.empty() || rest[0] != '[')
+		return false;
+
+	auto end = rest.find(']');
+
+	if(end == std::string_view::npos || end == 1)
+		return false;
+
+	line.protocol = rest.substr(1, end - 1);
+	rest.remove_prefix(end + 1);
+
+	if(rest.size() && rest[0] == ':')
+		line.message = rest.substr(1);
+
+	return true;
+}
+
+DebugLine DebugLine::Parse(std::string_view text)
+{
+	DebugLine log{ .kind = Kind::Log, .text = text };
+	DebugLine result = log;
+
+	if(text.starts_with("ws["))
+	{
+		result.kind = Kind::Message;
+		return ParseRoute(text.substr(2), result)? result : log;
+	}
+
+	size_t scheme = text.starts_with("ws://")? 5 : text.starts_with("wss://")? 6 : 0;
+
+	if(scheme == 0)
+		return log;
+
+	auto rest = text.substr(scheme);
+	auto colon = rest.find(':');
+
+	if(colon == std::string_view::npos || colon == 0)
+		return log;
+
+	result.kind = Kind::Url;
+	result.host = rest.substr(0, colon);
+	rest.remove_prefix(colon + 1);
+
+	size_t digits = 0;
+
+	for(; digits < rest.size() && digits < 6 && '0' <= rest[digits] && rest[digits] <= '9'; ++digits)
+		result.port = result.port * 10 + (rest[digits] - '0');
+
+	rest.remove_prefix(digits);
+
+	return ParseRoute(rest, result)? result : log;
+}
+
+// the start of the first line at or after i that begins with ws, length if there isn't one.
+// i has to be the start of a line or a newline.
+static size_t FindWsLine(const char * in, size_t i, size_t length)
+{
+	if(i + 2 <= length && in[i] == 'w' && in[i+1] == 's')
+		return i;
+
+#ifdef DEBUGLINE_SSE2
+// "\nws" anywhere in the block: the newline, the w one byte on and the s two on.
+	const __m128i newline = _mm_set1_epi8('\n');
+	const __m128i w = _mm_set1_epi8('w');
+	const __m128i s = _mm_set1_epi8('s');
+
+	for(; i + 18 <= length; i += 16)
+	{
+		__m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i const*)(in + i)), newline);
+		__m128i b = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i const*)(in + i + 1)), w);
+		__m128i c = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i const*)(in + i + 2)), s);
+		uint32_t mask = uint32_t(_mm_movemask_epi8(_mm_and_si128(_mm_and_si128(a, b), c)));
+
+		if(mask)
+		{
+#ifdef _MSC_VER
+			unsigned long index;
+			_BitScanForward(&index, mask);
+			return i + index + 1;
+#else
+			return i + __builtin_ctz(mask) + 1;
+#endif
+		}
+	}
+#endif
+
+	for(; i + 2 < length; ++i)
+	{
+		if(in[i] == '\n' && in[i+1] == 'w' && in[i+2] == 's')
+			return i + 1;
+	}
+
+	return length;
+}
+
+void DebugLine::Scan(std::string_view reply, std::vector<DebugLine> & lines)
+{
+	auto in = reply.data();
+	auto length = reply.size();
+	size_t start = 0;
+	size_t i = 0;
+
+	lines.clear();
+
+	while(i < length)
+	{
+		auto ws = FindWsLine(in, i, length);
+
+		if(ws == length)
+			break;
+
+		auto newline = (const char*)memchr(in + ws, '\n', length - ws);
+		size_t end = newline? newline - in : length;
+		auto line = Parse(reply.substr(ws, end - ws));
+
+	// looked like one but isn't, it stays part of the log around it.
+		if(line.kind != Kind::Log)
+		{
+			if(ws > start)
+				lines.push_back(DebugLine{ .kind = Kind::Log, .text = reply.substr(start, ws - start) });
+
+			lines.push_back(line);
+			start = end < length? end + 1 : length;
+		}
+
+		i = end;
+	}
+
+	if(start < length)
+		lines.push_back(DebugLine{ .kind = Kind::Log, .text = reply.substr(start) });
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <string_view>
+#include <vector>
+
+// a line of the engine's debug log, as far as the websocket server is concerned:
+//	ws://host:port[protocol]			connect to host (wss:// too)
+//	ws://host:port[protocol]:message	connect and send message
+//	ws[protocol]:message				send message to everyone on protocol
+// anything else is just log. every field is a view of the text it came from.
+struct DebugLine
+{
+	enum class Kind
+	{
+		Log,
+		Url,
+		Message,
+	};
+
+// one line without its newline; Log unless it is one of the above with a protocol.
+	static DebugLine Parse(std::string_view line);
+
+// splits a DBG: POLL reply into runs of log (newlines and all) and single ws lines, in order.
+// lines is cleared first, keep it around so its buffer is reused.
+	static void Scan(std::string_view reply, std::vector<DebugLine> & lines);
+
+	Kind kind{};
+	std::string_view text{};
+	std::string_view host{};
+	int port{};
+	std::string_view protocol{};
+	std::string_view message{};
+};
@@ -0,0 +1,319 @@
+#include "EngineRegistry.h"
+#include "RequestScheduler.h"
+#include "WebsocketServer.h"
+#include <algorithm>
+#include <cstdio>
+
+using namespace std::chrono_literals;
+
+// how often the debug log is polled: as often as this just after output or a client's request,
+static const std::chrono::milliseconds POLL_MIN = 20ms;
+// doubling every time it comes back empty up to this.
+static const std::chrono::milliseconds POLL_MAX = 500ms;
+
+EngineRegistry::EngineRegistry(WebsocketServer * server, Callback onClosed) :
+	_server(server),
+	_onClosed(std::move(onClosed))
+{
+}
+
+EngineRegistry::~EngineRegistry()
+{
+	std::vector<std::shared_ptr<Engine>> engines;
+
+	{
+		std::lock_guard lock(_mutex);
+		engines.swap(_engines);
+	}
+
+	for(auto & engine : engines)
+	{
+		engine->Stop();
+		_server->OnGameClosed(engine);
+	}
+}
+
+size_t EngineRegistry::size()
+{
+	std::lock_guard lock(_mutex);
+	return _engines.size();
+}
+
+bool EngineRegistry::IsOpen(std::string_view address)
+{
+	std::lock_guard lock(_mutex);
+
+	return std::any_of(_engines.begin(), _engines.end(), [address](auto const& engine)
+	{
+		return engine->interface->_address == address;
+	});
+}
+
+void EngineRegistry::Update(bool discover)
+{
+	std::vector<std::shared_ptr<Engine>> closed;
+
+	{
+		std::lock_guard lock(_mutex);
+
+		for(auto i = 0u; i < _engines.size(); ++i)
+		{
+			if(_engines[i]->isClosed())
+			{
+				closed.push_back(std::move(_engines[i]));
+				_engines.erase(_engines.begin()+i);
+				--i;
+			}
+		}
+	}
+
+// take them off the server before tearing them down so nobody sends them anything else,
+// once the router has stopped so a late ws line can't hand the server one it just let go of.
+	for(auto & engine : closed)
+	{
+		engine->Stop();
+		_server->OnGameClosed(engine);
+	}
+
+// a websocket thread still using one has its own reference, it goes when that's done.
+	closed.clear();
+
+// keep going until there's nothing new, several engines may have started since we last looked.
+	while(discover)
+	{
+		auto interface = SharedMemoryInterface::Open([this](std::string_view address) { return IsOpen(address); });
+
+		if(interface == nullptr)
+			break;
+
+		std::shared_ptr<Engine> engine(new Engine(_nextId++, std::move(interface), _server, _onClosed));
+		_server->OnGameOpened(engine);
+
+		std::lock_guard lock(_mutex);
+		_engines.push_back(std::move(engine));
+	}
+}
+
+EngineRegistry::Engine::Engine(int id, std::unique_ptr<SharedMemoryInterface> interface, WebsocketServer * server, Callback onClosed) :
+	id(id),
+	interface(std::move(interface)),
+	_server(server),
+	_onClosed(std::move(onClosed))
+{
+	scheduler.reset(new RequestScheduler(this->interface.get()));
+	_router = std::thread(&Engine::Route, this);
+	_thread = std::thread(&Engine::Run, this);
+}
+
+EngineRegistry::Engine::~Engine()
+{
+	Stop();
+
+	scheduler = nullptr;
+	interface = nullptr;
+}
+
+void EngineRegistry::Engine::Stop()
+{
+	{
+		std::lock_guard lock(_mutex);
+		_running = false;
+	}
+
+	_sleep.notify_all();
+
+	if(_thread.joinable())
+		_thread.join();
+
+	if(_router.joinable() == false)
+		return;
+
+// the poll thread is gone so we're the producer now, the router finishes what's queued first.
+	std::string stop;
+
+	while(_debugOutput.push(std::move(stop)) == false)
+		_debugOutput.waitForRoom();
+
+	_router.join();
+}
+
+std::string EngineRegistry::Engine::Describe() const
+{
+	return Describe(std::to_string(id));
+}
+
+std::string EngineRegistry::Engine::Describe(std::string_view prefix) const
+{
+	auto name = SharedMemoryInterface::utf8FromCp1252(interface->_name);
+
+	char buffer[256];
+	snprintf(buffer, sizeof(buffer), "%.*s %s %d.%d %s", int(prefix.size()), prefix.data(), interface->_engine.c_str(), interface->versionMajor, interface->versionMinor, name.c_str());
+	return buffer;
+}
+
+bool EngineRegistry::Engine::Matches(std::string_view selector) const
+{
+	return selector == std::to_string(id) || selector == interface->_name || selector == interface->_address;
+}
+
+void EngineRegistry::Engine::Sleep(std::chrono::milliseconds duration)
+{
+	std::unique_lock lock(_mutex);
+	_sleep.wait_for(lock, duration, [this]() { return _running == false; });
+}
+
+bool EngineRegistry::Engine::WaitToPoll(std::chrono::milliseconds duration)
+{
+	std::unique_lock lock(_mutex);
+	auto deadline = std::chrono::steady_clock::now() + duration;
+	bool nudged = false;
+
+	while(_running)
+	{
+	// not straight away, give the request that nudged us a moment to run.
+		if(_nudged)
+		{
+			_nudged = false;
+			nudged = true;
+			deadline = std::min(deadline, std::chrono::steady_clock::now() + POLL_MIN);
+		}
+
+		if(_sleep.wait_until(lock, deadline, [this]() { return _running == false || _nudged; }) == false)
+			break;
+	}
+
+	return nudged;
+}
+
+void EngineRegistry::Engine::Nudge()
+{
+	{
+		std::lock_guard lock(_mutex);
+		_nudged = true;
+	}
+
+	++_nudges;
+	_sleep.notify_all();
+}
+
+std::string EngineRegistry::Engine::GetStatistics()
+{
+	uint64_t polls = _polls;
+	uint64_t empty = _emptyPolls;
+
+	char buffer[256];
+	snprintf(buffer, sizeof(buffer), "debug poll: every %dms, %llu polls, %llu empty (%.1f%%), %llu nudged by clients, %llu waits on the router\n",
+		int(_pollInterval), (unsigned long long)polls, (unsigned long long)empty,
+		polls? 100.0 * empty / polls : 0.0, (unsigned long long)_nudges, (unsigned long long)_routerStalls);
+
+	return buffer;
+}
+
+void EngineRegistry::Engine::Run()
+{
+	auto interval = POLL_MIN;
+	_pollInterval = int(interval.count());
+
+	Sleep(50ms);
+
+	while(_running)
+	{
+		if(interface->isClosed())
+		{
+			_closed = true;
+
+			if(_onClosed)
+				_onClosed();
+
+			return;
+		}
+
+// vivarium has no debug log to poll, just keep an eye on it.
+		if(interface->isDDE())
+		{
+			Sleep(1000ms);
+			continue;
+		}
+
+// the engine answers DBG: POLL straight away whether or not there is anything, there's no waiting on it for output.
+		auto response = scheduler->send(nullptr, RequestScheduler::Priority::Background, "DBG: POLL");
+		++_polls;
+
+		if (response.isError == true)
+		{
+			fprintf(stderr, "%s\n", response.text.data());
+		// backs off the same as an empty poll, an engine that keeps failing shouldn't have us spinning.
+			interval = std::min(interval * 2, POLL_MAX);
+		}
+		else if (response.text.size())
+		{
+		// only if the router is this far behind does the poll wait for it.
+			if(_debugOutput.push(std::move(response.text)) == false)
+			{
+				++_routerStalls;
+
+				do
+					_debugOutput.waitForRoom();
+				while(_debugOutput.push(std::move(response.text)) == false);
+			}
+
+			interval = POLL_MIN;
+		}
+		else
+		{
+			++_emptyPolls;
+			interval = std::min(interval * 2, POLL_MAX);
+		}
+
+		_pollInterval = int(interval.count());
+
+		if(WaitToPoll(interval))
+		{
+			interval = POLL_MIN;
+			_pollInterval = int(interval.count());
+		}
+	}
+}
+
+void EngineRegistry::Engine::Route()
+{
+	std::string text;
+
+	for(;;)
+	{
+		while(_debugOutput.pop(text) == false)
+			_debugOutput.wait();
+
+		if(text.empty())
+			return;
+
+		OnDebugOutput(text);
+	}
+}
+
+// lines starting with ws are for the websocket server, the rest goes to stdout.
+void EngineRegistry::Engine::OnDebugOutput(std::string const& text)
+{
+	bool wrote = false;
+
+	DebugLine::Scan(text, _lines);
+
+	for(auto & line : _lines)
+	{
+		if(line.kind == DebugLine::Kind::Log)
+		{
+			wrote = true;
+			fprintf(stdout, "%.*s", int(line.text.size()), line.text.data());
+		}
+		else
+		{
+			_server->Parse(line, nullptr, this);
+		}
+	}
+
+	if(wrote)
+	{
+// TODO: if deamon open window to display stdout.
+		fflush(stdout);
+	}
+}
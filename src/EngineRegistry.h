@@ -0,0 +1,107 @@
+#pragma once
+#include "SharedMemoryInterface.h"
+#include "DebugLine.h"
+#include "SpscRing.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+class RequestScheduler;
+class WebsocketServer;
+
+// keeps track of every engine we can see, there can be several running at once.
+// - main calls Update() whenever it wakes to pick up new engines and let go of closed ones.
+// - each engine has its own scheduler and polls its debug log on its own thread,
+//   so one slow game doesn't hold up the others.
+// - the poll backs off while the log stays empty (or the engine keeps failing) and comes back quickly once there is
+//   output or a client sends the game something (which is usually what makes output).
+// - what the poll brings back is handed to a second thread that splits it into lines and
+//   sends them on, so a slow client never holds up the next poll.
+class EngineRegistry
+{
+public:
+struct Engine;
+using Callback = std::function<void()>;
+
+// onClosed runs on the engine's thread when it notices the game went away.
+	EngineRegistry(WebsocketServer * server, Callback onClosed);
+	~EngineRegistry();
+
+// always lets go of closed engines, only looks for new ones if discover is set.
+	void Update(bool discover);
+	size_t size();
+
+private:
+	bool IsOpen(std::string_view address);
+
+	WebsocketServer * _server{};
+	Callback _onClosed;
+
+	std::mutex _mutex;
+// shared with the server, which hands out references to whoever is talking to one.
+	std::vector<std::shared_ptr<Engine>> _engines;
+	int _nextId{1};
+};
+
+struct EngineRegistry::Engine
+{
+	Engine(int id, std::unique_ptr<SharedMemoryInterface> interface, WebsocketServer * server, Callback onClosed);
+	~Engine();
+
+// "<id> <engine> <major>.<minor> <name>"
+	std::string Describe() const;
+// the same with prefix (an event, OnGameOpened) in place of the id.
+// both are utf8, the name is converted from the game's cp1252.
+	std::string Describe(std::string_view prefix) const;
+// selector is an id, the game's name or its address.
+	bool Matches(std::string_view selector) const;
+
+	bool isClosed() const { return _closed; }
+
+// a client sent the game something, look at the debug log again soon.
+	void Nudge();
+// stops polling and waits for the router to finish, nothing more reaches the server after this.
+	void Stop();
+	std::string GetStatistics();
+
+	const int id;
+	std::unique_ptr<SharedMemoryInterface> interface;
+	std::unique_ptr<RequestScheduler> scheduler;
+
+private:
+	void Run();
+	void Sleep(std::chrono::milliseconds);
+// Sleep, but cut short by Nudge; true if it was.
+	bool WaitToPoll(std::chrono::milliseconds);
+// the router thread.
+	void Route();
+	void OnDebugOutput(std::string const& text);
+
+	WebsocketServer * _server{};
+	Callback _onClosed;
+
+	std::mutex _mutex;
+	std::condition_variable _sleep;
+	std::atomic<bool> _running{true};
+	std::atomic<bool> _closed{false};
+	bool _nudged{};
+	std::thread _thread;
+
+// replies to DBG: POLL on their way to the router, an empty one tells it to stop.
+	SpscRing<std::string, 64> _debugOutput;
+	std::thread _router;
+	std::atomic<uint64_t> _routerStalls{};
+// the router's, kept so scanning a reply doesn't allocate.
+	std::vector<DebugLine> _lines;
+
+	std::atomic<uint64_t> _polls{};
+	std::atomic<uint64_t> _emptyPolls{};
+	std::atomic<uint64_t> _nudges{};
+	std::atomic<int> _pollInterval{};
+};
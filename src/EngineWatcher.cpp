@@ -0,0 +1,28 @@
+#include "EngineWatcher.h"
+#include <cstdio>
+#include <stdexcept>
+
+#ifdef __linux__
+#include "Posix/PosixEngineWatcher.h"
+
+std::unique_ptr<EngineWatcher> EngineWatcher::Open(Callback onChange)
+{
+	try
+	{
+		return std::unique_ptr<EngineWatcher>(new PosixEngineWatcher(std::move(onChange)));
+	}
+	catch(std::exception & e)
+	{
+		fprintf(stderr, "%s, falling back to polling.\n", e.what());
+		return nullptr;
+	}
+}
+#else
+
+// windows finds engines by their window, nothing to watch there.
+std::unique_ptr<EngineWatcher> EngineWatcher::Open(Callback)
+{
+	return nullptr;
+}
+
+#endif
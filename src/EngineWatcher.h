@@ -0,0 +1,17 @@
+#pragma once
+#include <functional>
+#include <memory>
+
+// tells the main loop when an engine might have started or stopped so it doesn't have to keep looking.
+// - onChange runs on the watcher's own thread, it should just wake someone up.
+// - Open returns nullptr when the platform can't tell us, poll instead.
+class EngineWatcher
+{
+public:
+	using Callback = std::function<void()>;
+
+	static std::unique_ptr<EngineWatcher> Open(Callback onChange);
+
+	EngineWatcher() = default;
+	virtual ~EngineWatcher() = default;
+};
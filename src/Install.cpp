@@ -0,0 +1,170 @@
+#include "Install.h"
+#include "Caos.h"
+#include "Support.h"
+#include <cstdio>
+
+enum
+{
+// comfortably under what one connection to the engine takes, so a chunk is one round trip.
+	INSTALL_CHUNK = 32000,
+// one running and one waiting behind it.
+	PIPELINE_DEPTH = 2,
+};
+
+std::shared_ptr<Install> Install::Start(std::string id, std::string script, bool c1, RequestScheduler * scheduler, Output output)
+{
+	std::shared_ptr<Install> install(new Install(std::move(id), std::move(script), c1, scheduler, std::move(output)));
+
+	char buffer[256];
+	snprintf(buffer, sizeof(buffer), "OnInstallStarted %s %zu %zu", install->_id.c_str(), install->_chunks.size(), install->_script.size());
+	install->Send(buffer);
+
+// the engine would only see it was wrong once it got to the bad chunk, after running the ones before it.
+	auto error = Caos::Validate(install->_script, Caos::GetDialect(*scheduler->_interface));
+
+	if(error.size())
+	{
+		install->_finished = true;
+		snprintf(buffer, sizeof(buffer), "OnInstallError %s 0 %zu %lld", install->_id.c_str(), install->_chunks.size(), install->Elapsed());
+		install->Send(buffer, error);
+		return install;
+	}
+
+	if(install->_chunks.empty())
+	{
+		install->_finished = true;
+		snprintf(buffer, sizeof(buffer), "OnInstallDone %s 0 %zu %lld", install->_id.c_str(), install->_script.size(), install->Elapsed());
+		install->Send(buffer);
+		return install;
+	}
+
+	for(int i = 0; i < PIPELINE_DEPTH; ++i)
+		install->SubmitNext();
+
+	return install;
+}
+
+Install::Install(std::string id, std::string script, bool c1, RequestScheduler * scheduler, Output output) :
+	_id(std::move(id)),
+	_script(std::move(script)),
+	_scheduler(scheduler),
+	_output(std::move(output)),
+	_started(Clock::now())
+{
+	auto endm = FindEndm(_script, c1);
+	_chunks = ChunkMessage(_script, endm, INSTALL_CHUNK);
+}
+
+// the engine went away with chunks still queued, they were thrown out along with us.
+Install::~Install()
+{
+	if(_finished)
+		return;
+
+	char buffer[256];
+	snprintf(buffer, sizeof(buffer), "OnInstallError %s %zu %zu %lld", _id.c_str(), _sent, _chunks.size(), Elapsed());
+	Send(buffer, "Game is closing.");
+}
+
+void Install::cancel()
+{
+	size_t sent;
+
+	{
+		std::lock_guard lock(_mutex);
+
+		if(_finished)
+			return;
+
+		_finished = true;
+		sent = _sent;
+	}
+
+// before the drop, the chunks it throws out may be all that's keeping us alive.
+	char buffer[256];
+	snprintf(buffer, sizeof(buffer), "OnInstallCancelled %s %zu %zu %lld", _id.c_str(), sent, _chunks.size(), Elapsed());
+	Send(buffer);
+
+// whatever is waiting behind the running chunk never goes.
+	_scheduler->drop(this);
+}
+
+void Install::SubmitNext()
+{
+	size_t chunk;
+
+	{
+		std::lock_guard lock(_mutex);
+
+		if(_finished || _submitted == _chunks.size())
+			return;
+
+		chunk = _submitted++;
+	}
+
+// the scheduler keeps us alive until the reply comes back.
+	_scheduler->submit(this, RequestScheduler::Priority::Bulk, std::string(_chunks[chunk]), [self = shared_from_this(), chunk](RequestScheduler::Response response)
+	{
+		self->OnReply(chunk, std::move(response));
+	});
+}
+
+void Install::OnReply(size_t chunk, RequestScheduler::Response && response)
+{
+	bool done{};
+	bool failed{};
+
+	{
+		std::lock_guard lock(_mutex);
+
+		if(_finished)
+			return;
+
+		_sent = chunk + 1;
+		done = _sent == _chunks.size();
+		failed = response.isError || Caos::IsErrorReply(response.text);
+		_finished = failed || done;
+	}
+
+	char buffer[256];
+
+// the engine says a chunk failed in its reply, the rest of the install would run without it.
+	if(failed)
+	{
+		snprintf(buffer, sizeof(buffer), "OnInstallError %s %zu %zu %lld", _id.c_str(), _sent, _chunks.size(), Elapsed());
+		Send(buffer, response.text);
+		_scheduler->drop(this);
+		return;
+	}
+
+	size_t bytes = _chunks[chunk].data() + _chunks[chunk].size() - _script.data();
+	snprintf(buffer, sizeof(buffer), "OnInstallProgress %s %zu %zu %zu %zu %lld", _id.c_str(), _sent, _chunks.size(), bytes, _script.size(), Elapsed());
+	Send(buffer, response.text);
+
+	if(done)
+	{
+		snprintf(buffer, sizeof(buffer), "OnInstallDone %s %zu %zu %lld", _id.c_str(), _chunks.size(), _script.size(), Elapsed());
+		Send(buffer);
+	}
+	else
+		SubmitNext();
+}
+
+long long Install::Elapsed() const
+{
+	return (long long)std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - _started).count();
+}
+
+// the event on the first line, anything the engine said after it.
+void Install::Send(std::string_view event, std::string_view detail)
+{
+	std::string message(event);
+
+	if(detail.size())
+	{
+		message += '\n';
+		message += detail;
+	}
+
+	_output(message);
+}
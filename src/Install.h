@@ -0,0 +1,58 @@
+#pragma once
+#include "RequestScheduler.h"
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// a big script (an agent install) sent to the engine a chunk at a time, with each chunk's
+// reply going back to the client as soon as it arrives so a long install doesn't look hung.
+// - the next chunk is queued behind the one running, so the engine never waits on the client.
+// - cancel() stops it straight away, the chunk already running still finishes but its reply is dropped.
+// - a script Caos::Validate turns away fails before any of it is sent, one the engine
+//   answers with an error (Caos::IsErrorReply) stops at that chunk.
+// - it queues under its own client id, the client's other requests still get their turn.
+// events are text messages, like OnGameOpened:
+//	OnInstallStarted <id> <chunks> <bytes>
+//	OnInstallProgress <id> <chunk> <chunks> <bytes sent> <bytes> <ms>, then a line with the chunk's reply
+//	OnInstallDone <id> <chunks> <bytes> <ms>
+//	OnInstallCancelled <id> <chunk> <chunks> <ms>
+//	OnInstallError <id> <chunk> <chunks> <ms>, then a line with what went wrong
+class Install : public std::enable_shared_from_this<Install>
+{
+public:
+using Output = std::function<void(std::string const&)>;
+using Clock = std::chrono::steady_clock;
+
+// c1 scripts have [] strings, see FindEndm.
+	static std::shared_ptr<Install> Start(std::string id, std::string script, bool c1, RequestScheduler * scheduler, Output output);
+	~Install();
+
+// the scheduler must still be alive.
+	void cancel();
+
+	std::string const& id() const { return _id; }
+
+private:
+	Install(std::string id, std::string script, bool c1, RequestScheduler * scheduler, Output output);
+
+	void SubmitNext();
+	void OnReply(size_t chunk, RequestScheduler::Response && response);
+	long long Elapsed() const;
+	void Send(std::string_view event, std::string_view detail = {});
+
+	std::string _id;
+	std::string _script;
+	std::vector<std::string_view> _chunks;
+	RequestScheduler * _scheduler{};
+	Output _output;
+	Clock::time_point _started;
+
+	std::mutex _mutex;
+	size_t _submitted{};
+	size_t _sent{};
+	bool _finished{};
+};
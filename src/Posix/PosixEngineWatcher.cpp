@@ -0,0 +1,152 @@
+#include "PosixEngineWatcher.h"
+
+#ifdef __linux__
+#include "PosixSMI.h"
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+enum
+{
+	DIRECTORY_EVENTS = IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF,
+	HOME_EVENTS = IN_CREATE | IN_MOVED_TO,
+};
+
+PosixEngineWatcher::PosixEngineWatcher(Callback onChange) :
+	_onChange(std::move(onChange))
+{
+	auto & port = PosixSMI::GetPortFile();
+	_directory = port.parent_path();
+	_file = port.filename().string();
+
+	_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+	if(_inotify < 0)
+	{
+		throw std::runtime_error("inotify unavailable: " + std::string(strerror(errno)));
+	}
+
+	if(pipe(_wake) < 0)
+	{
+		close(_inotify);
+		throw std::runtime_error("Watcher pipe creation error: " + std::string(strerror(errno)));
+	}
+
+	fcntl(_wake[0], F_SETFL, fcntl(_wake[0], F_GETFL) | O_NONBLOCK);
+
+	_homeWatch = inotify_add_watch(_inotify, _directory.parent_path().c_str(), HOME_EVENTS);
+	WatchDirectory();
+
+	if(_homeWatch < 0 && _directoryWatch < 0)
+	{
+		auto error = std::string(strerror(errno));
+		close(_inotify);
+		close(_wake[0]);
+		close(_wake[1]);
+		throw std::runtime_error("Unable to watch " + _directory.string() + ": " + error);
+	}
+
+	_thread = std::thread(&PosixEngineWatcher::Run, this);
+}
+
+PosixEngineWatcher::~PosixEngineWatcher()
+{
+	_running = false;
+
+	char c = 0;
+	(void)!write(_wake[1], &c, 1);
+
+	if(_thread.joinable())
+		_thread.join();
+
+	close(_inotify);
+	close(_wake[0]);
+	close(_wake[1]);
+}
+
+void PosixEngineWatcher::WatchDirectory()
+{
+	if(_directoryWatch >= 0)
+		return;
+
+	_directoryWatch = inotify_add_watch(_inotify, _directory.c_str(), DIRECTORY_EVENTS);
+}
+
+void PosixEngineWatcher::Run()
+{
+	pollfd fds[2] =
+	{
+		{ _inotify, POLLIN, 0 },
+		{ _wake[0], POLLIN, 0 },
+	};
+
+	while(_running)
+	{
+		if(poll(fds, 2, -1) < 0)
+		{
+			if(errno == EINTR)
+				continue;
+
+			fprintf(stderr, "engine watcher stopped: %s\n", strerror(errno));
+			return;
+		}
+
+		if(fds[0].revents)
+			OnEvents();
+	}
+}
+
+void PosixEngineWatcher::OnEvents()
+{
+	alignas(inotify_event) char buffer[4096];
+	bool changed = false;
+
+	while(true)
+	{
+		auto length = read(_inotify, buffer, sizeof(buffer));
+
+		if(length <= 0)
+			break;
+
+		for(char * ptr = buffer; ptr < buffer + length; )
+		{
+			auto event = (inotify_event const*)ptr;
+			ptr += sizeof(inotify_event) + event->len;
+
+			std::string_view name(event->len? event->name : "");
+			name = name.substr(0, name.find('\0'));
+
+			if(event->wd == _homeWatch)
+			{
+				if(name == _directory.filename().string())
+				{
+					WatchDirectory();
+					changed = true;
+				}
+			}
+			else if(event->wd == _directoryWatch)
+			{
+// the directory itself went away, wait for it to come back.
+				if(event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+				{
+					inotify_rm_watch(_inotify, _directoryWatch);
+					_directoryWatch = -1;
+					changed = true;
+				}
+				else if(name == _file)
+				{
+					changed = true;
+				}
+			}
+		}
+	}
+
+	if(changed)
+		_onChange();
+}
+
+#endif
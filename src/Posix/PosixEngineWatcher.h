@@ -0,0 +1,35 @@
+#pragma once
+
+#ifdef __linux__
+#include "EngineWatcher.h"
+#include <atomic>
+#include <filesystem>
+#include <thread>
+
+// watches ~/.creaturesengine with inotify, the engine (re)writes port in there when it starts.
+// if the directory doesn't exist yet we watch home for it to be made.
+class PosixEngineWatcher : public EngineWatcher
+{
+public:
+	PosixEngineWatcher(Callback onChange);
+	~PosixEngineWatcher();
+
+private:
+	void Run();
+	void WatchDirectory();
+	void OnEvents();
+
+	Callback _onChange;
+	std::filesystem::path _directory;
+	std::string _file;
+
+	int _inotify{-1};
+	int _homeWatch{-1};
+	int _directoryWatch{-1};
+	int _wake[2]{-1, -1};
+
+	std::atomic<bool> _running{true};
+	std::thread _thread;
+};
+
+#endif
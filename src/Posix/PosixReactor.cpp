@@ -0,0 +1,403 @@
+#include "PosixReactor.h"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <cerrno>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+enum
+{
+// receive buffers start here and double whenever they fill up.
+	INITIAL_BUFFER = 16 * 1024,
+	SCRATCH_BUFFER = 64 * 1024,
+// buffers the completion didn't keep are reused, unless they grew past this.
+	MAX_SPARE_BUFFER = 1024 * 1024,
+	MAX_SPARE_BUFFERS = 4,
+	MAX_EVENTS = 64,
+// wake up this often even with nothing to do so timeouts still fire.
+	IDLE_WAIT_MS = 1000,
+};
+
+PosixReactor::PosixReactor()
+{
+	if(pipe(_wake) < 0)
+	{
+		throw std::runtime_error("Reactor pipe creation error: " + std::string(strerror(errno)));
+	}
+
+	fcntl(_wake[0], F_SETFL, fcntl(_wake[0], F_GETFL) | O_NONBLOCK);
+	fcntl(_wake[1], F_SETFL, fcntl(_wake[1], F_GETFL) | O_NONBLOCK);
+
+#ifdef __linux__
+	_poller = epoll_create1(EPOLL_CLOEXEC);
+
+	if(_poller < 0)
+	{
+		close(_wake[0]);
+		close(_wake[1]);
+		throw std::runtime_error("epoll creation error: " + std::string(strerror(errno)));
+	}
+
+	epoll_event event{};
+	event.events = EPOLLIN;
+	event.data.fd = _wake[0];
+	epoll_ctl(_poller, EPOLL_CTL_ADD, _wake[0], &event);
+#endif
+
+	_thread = std::thread(&PosixReactor::Run, this);
+}
+
+PosixReactor::~PosixReactor()
+{
+	stop();
+
+	if(_poller >= 0) close(_poller);
+	close(_wake[0]);
+	close(_wake[1]);
+}
+
+void PosixReactor::stop()
+{
+	{
+		std::lock_guard lock(_mutex);
+		_running = false;
+	}
+
+	Wake();
+
+	if(_thread.joinable() && isReactorThread() == false)
+		_thread.join();
+}
+
+void PosixReactor::submit(int fd, std::initializer_list<std::string_view> payload, Completion completion, std::chrono::milliseconds timeout, Filter filter)
+{
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+	std::unique_ptr<Job> job(new Job);
+	job->fd = fd;
+
+	for(auto & buffer : payload)
+	{
+		if(buffer.size())
+			job->payload.push_back({ const_cast<char*>(buffer.data()), buffer.size() });
+	}
+
+	job->completion = std::move(completion);
+	job->filter = std::move(filter);
+	job->deadline = std::chrono::steady_clock::now() + timeout;
+
+// checked under the lock, so the job either makes it in before run() takes what's left or is turned away here.
+	{
+		std::lock_guard lock(_mutex);
+
+		if(_running)
+		{
+			_submitted.push_back(std::move(job));
+			job = nullptr;
+		}
+	}
+
+	if(job)
+	{
+		close(fd);
+		job->completion({}, ECANCELED);
+		return;
+	}
+
+	Wake();
+}
+
+void PosixReactor::Wake()
+{
+	char c = 0;
+	(void)!write(_wake[1], &c, 1);
+}
+
+void PosixReactor::Watch(Job & job, bool writing)
+{
+	job.writing = writing;
+
+#ifdef __linux__
+	epoll_event event{};
+	event.events = writing? EPOLLOUT : EPOLLIN | EPOLLRDHUP;
+	event.data.fd = job.fd;
+
+	if(epoll_ctl(_poller, EPOLL_CTL_MOD, job.fd, &event) < 0 && errno == ENOENT)
+		epoll_ctl(_poller, EPOLL_CTL_ADD, job.fd, &event);
+#endif
+}
+
+void PosixReactor::Unwatch(Job & job)
+{
+#ifdef __linux__
+	epoll_ctl(_poller, EPOLL_CTL_DEL, job.fd, nullptr);
+#else
+	(void)job;
+#endif
+}
+
+void PosixReactor::Run()
+{
+	std::vector<std::unique_ptr<Job>> submitted;
+	std::vector<int> ready;
+
+#ifdef __linux__
+	epoll_event events[MAX_EVENTS];
+#else
+	std::vector<pollfd> fds;
+#endif
+
+	while(_running)
+	{
+		{
+			std::lock_guard lock(_mutex);
+			submitted.swap(_submitted);
+		}
+
+		for(auto & job : submitted)
+		{
+			int fd = job->fd;
+			auto & slot = _jobs[fd];
+			slot = std::move(job);
+
+			if(_spare.size())
+			{
+				slot->reply = std::move(_spare.back());
+				_spare.pop_back();
+			}
+
+			Watch(*slot, true);
+		}
+
+		submitted.clear();
+
+		auto now = std::chrono::steady_clock::now();
+		int wait = IDLE_WAIT_MS;
+
+		for(auto & item : _jobs)
+		{
+			auto left = std::chrono::duration_cast<std::chrono::milliseconds>(item.second->deadline - now).count();
+			wait = std::max(0, std::min<int>(wait, left));
+		}
+
+		ready.clear();
+
+#ifdef __linux__
+		int n = epoll_wait(_poller, events, MAX_EVENTS, wait);
+
+		for(int i = 0; i < n; ++i)
+			ready.push_back(events[i].data.fd);
+#else
+		fds.clear();
+		fds.push_back({ _wake[0], POLLIN, 0 });
+
+		for(auto & item : _jobs)
+			fds.push_back({ item.first, short(item.second->writing? POLLOUT : POLLIN), 0 });
+
+		int n = poll(fds.data(), fds.size(), wait);
+
+		for(size_t i = 0; n > 0 && i < fds.size(); ++i)
+		{
+			if(fds[i].revents)
+				ready.push_back(fds[i].fd);
+		}
+#endif
+
+		for(int fd : ready)
+		{
+			if(fd == _wake[0])
+			{
+				char buffer[64];
+				while(read(_wake[0], buffer, sizeof(buffer)) > 0) {}
+				continue;
+			}
+
+			auto itr = _jobs.find(fd);
+
+			if(itr == _jobs.end())
+				continue;
+
+			if(itr->second->writing)
+				OnWritable(*itr->second);
+			else
+				OnReadable(*itr->second);
+		}
+
+		now = std::chrono::steady_clock::now();
+
+		for(auto itr = _jobs.begin(); itr != _jobs.end(); )
+		{
+			auto fd = itr->first;
+			bool expired = itr->second->deadline <= now;
+			++itr;
+
+			if(expired)
+				Finish(fd, ETIMEDOUT);
+		}
+	}
+
+// anything still in flight is never going to be answered.
+	{
+		std::lock_guard lock(_mutex);
+		for(auto & job : _submitted)
+			_jobs[job->fd] = std::move(job);
+		_submitted.clear();
+	}
+
+	while(_jobs.size())
+		Finish(_jobs.begin()->first, ECANCELED);
+}
+
+void PosixReactor::OnWritable(Job & job)
+{
+// the first time it's writable any connect still going has finished, one way or the other.
+	if(job.connected == false)
+	{
+		int error{};
+		socklen_t length = sizeof(error);
+
+		if(getsockopt(job.fd, SOL_SOCKET, SO_ERROR, &error, &length) < 0)
+			error = errno;
+
+		if(error)
+		{
+			Finish(job.fd, error);
+			return;
+		}
+
+		job.connected = true;
+	}
+
+// written counts whole buffers sent, a partial send trims the front of the next one.
+	while(job.written < job.payload.size())
+	{
+		msghdr message{};
+		message.msg_iov = job.payload.data() + job.written;
+		message.msg_iovlen = job.payload.size() - job.written;
+
+		auto r = sendmsg(job.fd, &message, MSG_NOSIGNAL);
+
+		if(r < 0)
+		{
+			if(errno == EWOULDBLOCK || errno == EAGAIN)
+				return;
+
+			if(errno == EINTR)
+				continue;
+
+			Finish(job.fd, errno);
+			return;
+		}
+
+		for(size_t length = r; length; )
+		{
+			auto & buffer = job.payload[job.written];
+			auto n = std::min(length, buffer.iov_len);
+
+			buffer.iov_base = (char*)buffer.iov_base + n;
+			buffer.iov_len -= n;
+			length -= n;
+
+			if(buffer.iov_len == 0)
+				++job.written;
+		}
+	}
+
+	Watch(job, false);
+}
+
+// reads straight into the job's reply, which is handed to the completion as is,
+// or a block at a time into scratch for the filter to put in the reply.
+void PosixReactor::OnReadable(Job & job)
+{
+	while(true)
+	{
+		char * buffer;
+		size_t size;
+
+		if(job.filter)
+		{
+			if(_scratch.empty())
+				_scratch.resize(SCRATCH_BUFFER);
+
+			buffer = _scratch.data();
+			size = _scratch.size();
+		}
+		else
+		{
+			if(job.used == job.reply.size())
+				job.reply.resize(std::max<size_t>(INITIAL_BUFFER, job.reply.size() * 2));
+
+			buffer = job.reply.data() + job.used;
+			size = job.reply.size() - job.used;
+		}
+
+		auto length = recv(job.fd, buffer, size, MSG_NOSIGNAL);
+
+		if(length > 0)
+		{
+			if(job.filter)
+			{
+				job.filter(job.reply, std::string_view(buffer, length));
+				job.used = job.reply.size();
+			}
+			else
+				job.used += length;
+
+			continue;
+		}
+
+// the engine hangs up once it has written the whole reply.
+		if(length == 0)
+		{
+			Finish(job.fd, 0);
+			return;
+		}
+
+		if(errno == EWOULDBLOCK || errno == EAGAIN)
+			return;
+
+		if(errno == EINTR)
+			continue;
+
+		Finish(job.fd, errno);
+		return;
+	}
+}
+
+void PosixReactor::Finish(int fd, int error)
+{
+	auto itr = _jobs.find(fd);
+
+	if(itr == _jobs.end())
+		return;
+
+	auto job = std::move(itr->second);
+	_jobs.erase(itr);
+
+	Unwatch(*job);
+	close(job->fd);
+
+	job->reply.resize(job->used);
+	job->completion(std::move(job->reply), error);
+
+// if the completion copied the reply rather than taking it we can have the buffer back.
+	auto capacity = job->reply.capacity();
+
+	if(INITIAL_BUFFER <= capacity && capacity <= MAX_SPARE_BUFFER && _spare.size() < MAX_SPARE_BUFFERS)
+	{
+		job->reply.clear();
+		_spare.push_back(std::move(job->reply));
+	}
+}
+
+#endif
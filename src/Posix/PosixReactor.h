@@ -0,0 +1,82 @@
+#pragma once
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// owns every socket we have open to the engine and drives them from one thread.
+// a job is: write the payload, then read until the engine hangs up; the completion
+// runs on the reactor thread so it must not block (submitting more work is fine).
+// the payload is gathered straight from the caller's buffers with sendmsg, they have
+// to stay alive until the completion runs (have the completion own them).
+// uses epoll on linux, poll() everywhere else.
+class PosixReactor
+{
+public:
+	using Completion = std::function<void(std::string && reply, int error)>;
+// appends what it makes of each block read to reply, instead of it being read into reply as is.
+	using Filter = std::function<void(std::string & reply, std::string_view block)>;
+
+	PosixReactor();
+	~PosixReactor();
+
+// takes ownership of fd (connected, or with a non-blocking connect still going).
+	void submit(int fd, std::initializer_list<std::string_view> payload, Completion completion, std::chrono::milliseconds timeout, Filter filter = {});
+
+// cancels whatever is still in flight and waits for the thread; anything submitted after is cancelled straight away.
+	void stop();
+
+	bool isReactorThread() const { return std::this_thread::get_id() == _thread.get_id(); }
+
+private:
+struct Job;
+	void Run();
+	void Wake();
+	void Watch(Job & job, bool writing);
+	void Unwatch(Job & job);
+
+	void OnWritable(Job & job);
+	void OnReadable(Job & job);
+	void Finish(int fd, int error);
+
+	std::mutex _mutex;
+	std::vector<std::unique_ptr<Job>> _submitted;
+
+// only touched by the reactor thread.
+	std::unordered_map<int, std::unique_ptr<Job>> _jobs;
+	std::vector<std::string> _spare;
+// filtered jobs read into this, so the raw reply never has to be held all at once.
+	std::string _scratch;
+
+	int _poller{-1};
+	int _wake[2]{-1, -1};
+	std::atomic<bool> _running{true};
+	std::thread _thread;
+};
+
+struct PosixReactor::Job
+{
+	int fd{-1};
+	std::vector<iovec> payload;
+	size_t written{};
+// reply is sized ahead of what has been read, used is how much of it is real.
+	std::string reply;
+	size_t used{};
+	Completion completion;
+	Filter filter;
+	std::chrono::steady_clock::time_point deadline;
+	bool writing{true};
+	bool connected{};
+};
+
+#endif
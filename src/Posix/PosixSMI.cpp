@@ -6,31 +6,47 @@
 #include <filesystem>
 #include <fstream>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <signal.h>
+#include <array>
+#include <charconv>
+#include <cstddef>
 #include <cstring>
+#include <future>
+#include <map>
 
-int PosixSMI::_connectionReset = 0;
+using namespace std::chrono_literals;
 
 enum
 {
-	BUFFER_SIZE = 4096
+// scripts longer than this are cut up at endm and sent a piece per connection.
+	MAX_CHUNK = 64000-10,
 };
 
-std::unique_ptr<SharedMemoryInterface> PosixSMI::Create()
+int PosixSMI::_connectionReset = 0;
+
+std::filesystem::path const& PosixSMI::GetPortFile()
 {
-	int port = 0;
-	int _socket = 0;
-	sockaddr_in serv_addr;
-	memset(&serv_addr, 0, sizeof(serv_addr));
+// the watcher thread asks for this too, so it has to be set up exactly once.
+	static const std::filesystem::path path = []()
+	{
+		auto home = getenv("HOME");
+		return std::filesystem::path(home? home : "") / ".creaturesengine/port";
+	}();
 
-	static std::filesystem::path path;
+	return path;
+}
 
-	if(path.empty())
-	{
-	  auto home = getenv("HOME");
-	  path = std::filesystem::path(home) /= ".creaturesengine/port";
-	}
+std::unique_ptr<SharedMemoryInterface> PosixSMI::Create(IsOpen const& isOpen)
+{
+// the port file only ever names the newest engine, remember it in case that one drops out and comes back.
+	static std::unique_ptr<Transport> transport;
+
+	auto path = GetPortFile();
 
 	if(!std::filesystem::exists(path))
 		return nullptr;
@@ -55,30 +71,119 @@ std::unique_ptr<SharedMemoryInterface> PosixSMI::Create()
 			if(file.is_open() == false)
 				return nullptr;
 
-			file >> port;
+			std::string text;
+			file >> text;
 			file.close();
+
+			transport = Transport::Parse(text);
 		}
 	}
 
-	serv_addr.sin_family = AF_INET;
-	serv_addr.sin_port = htons(port);
+	if(transport == nullptr || (isOpen && isOpen(transport->name)))
+		return nullptr;
+
+	return std::unique_ptr<SharedMemoryInterface>(new PosixSMI(*transport));
+}
+
+PosixSMI::Transport PosixSMI::Transport::Tcp(int port)
+{
+	Transport r;
+	auto & address = (sockaddr_in&)r.address;
+
+	address.sin_family = AF_INET;
+	address.sin_port = htons(port);
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	r.length = sizeof(sockaddr_in);
+	r.port = port;
+	r.name = "127.0.0.1:" + std::to_string(port);
+	return r;
+}
 
-	if(inet_aton("127.0.0.1", (struct in_addr *) &(serv_addr.sin_addr.s_addr)) < 0)
+PosixSMI::Transport PosixSMI::Transport::Unix(std::string_view path)
+{
+	Transport r;
+	auto & address = (sockaddr_un&)r.address;
+
+	if(path.empty() || path.size() >= sizeof(address.sun_path))
 	{
-		throw std::runtime_error("Invalid address/ Address not supported.");
+		throw std::runtime_error("Invalid unix socket path: " + std::string(path));
 	}
 
-	return std::unique_ptr<SharedMemoryInterface>(new PosixSMI(serv_addr, port));
+	address.sun_family = AF_UNIX;
+	memcpy(address.sun_path, path.data(), path.size());
+
+	r.length = offsetof(sockaddr_un, sun_path) + path.size() + 1;
+	r.name = "unix:" + std::string(path);
+	return r;
 }
 
-PosixSMI::PosixSMI(sockaddr_in & serv_addr, int port) :
-	serv_addr(serv_addr)
+std::unique_ptr<PosixSMI::Transport> PosixSMI::Transport::Parse(std::string_view text)
+{
+	try
+	{
+		if(text.starts_with("unix:"))
+			return std::unique_ptr<Transport>(new Transport(Unix(text.substr(5))));
+
+		int port = 0;
+		auto r = std::from_chars(text.data(), text.data() + text.size(), port);
+
+		if(r.ec == std::errc() && r.ptr == text.data() + text.size() && 0 < port && port < 65536)
+			return std::unique_ptr<Transport>(new Transport(Tcp(port)));
+	}
+	catch(std::exception & e)
+	{
+		fprintf(stderr, "%s\n", e.what());
+	}
+
+	return nullptr;
+}
+
+int PosixSMI::Transport::Connect() const
+{
+	int fd = socket(address.ss_family, SOCK_STREAM, 0);
+
+	if(fd < 0)
+	{
+		throw std::runtime_error("Socket creation error: " + std::string(strerror(errno)));
+	}
+
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+// a tcp connect that hasn't finished yet is left to the reactor, it waits for the socket to be writable anyway.
+	if(connect(fd, (sockaddr const*)&address, length) < 0 && errno != EINPROGRESS)
+	{
+		auto error = errno;
+		close(fd);
+		throw std::runtime_error("Connection failed: " + std::string(strerror(error)));
+	}
+
+	if(address.ss_family == AF_INET)
+	{
+		int _enable{1};
+
+	// scripts go out in one write and replies come back in one burst, don't let nagle or delayed acks sit on either.
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &_enable, sizeof(_enable));
+#ifdef TCP_QUICKACK
+		setsockopt(fd, IPPROTO_TCP, TCP_QUICKACK, &_enable, sizeof(_enable));
+#endif
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &_enable, sizeof(_enable));
+	}
+
+	return fd;
+}
+
+PosixSMI::PosixSMI(Transport const& transport) :
+	_transport(new Transport(transport)),
+	_reactor(new PosixReactor),
+	_pool(new ConnectionPool(*this))
 {
 	_engine = "C2E";
+	_address = transport.name;
 
 	try
 	{
-		_pid = GetPid(port);
+		_pid = transport.GetPid();
 
 		if(_pid)
 		{
@@ -107,94 +212,184 @@ PosixSMI::PosixSMI(sockaddr_in & serv_addr, int port) :
 
 PosixSMI::~PosixSMI()
 {
+// the cancelled completions can still reach SendChunk (and the retry path), closing first
+// turns those away and stopping before the reset keeps _reactor valid while they run.
+	_isClosed = true;
+	_reactor->stop();
+	_reactor.reset();
+	_pool->clear();
+}
+
+
+PosixSMI::Response PosixSMI::send1252(std::string_view message)
+{
+	std::shared_ptr<Request> request(new Request);
+	request->message = message;
+	return Wait(std::move(request));
 }
 
+PosixSMI::Response PosixSMI::send1252(Script const& script)
+{
+	std::shared_ptr<Request> request(new Request);
+	request->script = &script;
+	request->message = script.text;
+	request->decode = true;
+	return Wait(std::move(request));
+}
+
+// we wait for the reply so the engine can read straight out of the caller's buffer.
+PosixSMI::Response PosixSMI::Wait(std::shared_ptr<Request> request)
+{
+	if(_reactor->isReactorThread())
+	{
+		throw std::logic_error("send1252 called from the reactor thread would never return.");
+	}
+
+	std::promise<Response> promise;
+	auto future = promise.get_future();
+
+	request->callback = [&promise](Response response)
+	{
+		promise.set_value(std::move(response));
+	};
+
+	Submit(std::move(request));
+	return future.get();
+}
+
+void PosixSMI::send1252Async(Script script, Callback callback)
+{
+	std::shared_ptr<Request> request(new Request);
+	request->owned = std::move(script);
+	request->script = &request->owned;
+	request->message = request->owned.text;
+	request->decode = true;
+	request->callback = std::move(callback);
+
+	Submit(std::move(request));
+}
 
-PosixSMI::Response PosixSMI::send1252(std::string & message)
+void PosixSMI::Submit(std::shared_ptr<Request> request)
 {
 	if(_isClosed)
 	{
-		return Response{
+		request->callback(Response{
 			.text= "Port is not open.",
 			.isError=true,
 			.isBinary=false,
-		};
+		});
+		return;
 	}
 
-	if(message.capacity() < message.size()+8)
-		message.reserve(message.size()+8);
-
-	const char * error = nullptr;
-	std::string response;
-	std::string_view retn;
+	if(request->message.size() < MAX_CHUNK)
+		request->chunks = { request->message };
+	else if(request->script)
+		request->chunks = ChunkMessage(request->message, request->script->endm, MAX_CHUNK);
+	else
+		request->chunks = ChunkMessage(request->message, MAX_CHUNK);
 
-	auto chunks = ChunkMessage(message, 64000-10);
 	_timeout = false;
+	SendChunk(std::move(request));
+}
 
-	char buffer[8];
-	message.resize(message.size()+8, '\0');
+// each chunk gets its own connection, the engine answers once it sees rscr and then hangs up.
+void PosixSMI::SendChunk(std::shared_ptr<Request> request)
+{
+	if(_isClosed)
+	{
+		request->callback(Response{
+			.text= "Port is not open.",
+			.isError=true,
+			.isBinary=false,
+		});
+		return;
+	}
 
-	for(std::string_view & chunk : chunks)
+	if(request->next == request->chunks.size())
 	{
-		try
-		{
-			Socket socket(*this);
+		request->callback(Response{
+			.text= std::move(request->response),
+			.isError=false,
+			.isBinary=false,
+			.isAscii=request->decode && request->stream.isAscii,
+			.isUtf8=request->decode,
+		});
 
-			memcpy(buffer, &chunk.back(), 8);
-			strncpy(const_cast<char*>(&chunk.back()+1), "\nrscr\n", 8);
-			// second time in this loop causes: SIGPIPE: broken pipe
-			auto r = ::send(socket._socket, chunk.data(), chunk.size()+8, MSG_NOSIGNAL);
-			memcpy(const_cast<char*>(&chunk.back()), buffer, 8);
+		_pool->prime();
+		return;
+	}
 
-			if(r == -1)
-			{
-				error = socket.HandleError();
-
-				if(error)
-				{
-					return Response{
-						.text= error,
-						.isError=true,
-						.isBinary=false,
-					};
-				}
-			}
+	std::unique_ptr<Socket> socket;
 
-		// read the reply
-			do
-			{
-				auto retn = socket.read_message(error);
-				response += retn;
-			} while(retn.size() == BUFFER_SIZE);
+	try
+	{
+		if(request->retry)
+			socket.reset(new Socket(*this));
+		else
+			socket = _pool->acquire();
+	}
+	catch(std::exception & e)
+	{
+		_isClosed = true;
 
-			if(error)
-			{
-				return Response{
-					.text= error,
-					.isError=true,
-					.isBinary=false,
-				};
-			}
+		request->callback(Response{
+			.text= e.what(),
+			.isError=true,
+			.isBinary=false,
+		});
+		return;
+	}
+
+	auto chunk = request->chunks[request->next++];
+
+	PosixReactor::Filter filter;
+
+	if(request->decode)
+	{
+		filter = [request](std::string & reply, std::string_view block)
+		{
+			request->stream.write(reply, block);
+		};
+	}
+
+// the request outlives the job (the completion holds it) so both halves can be sent as they are.
+	_reactor->submit(socket->release(), { chunk, "\nrscr\n" }, [this, request](std::string && reply, int error)
+	{
+		// the engine can hang up on an idle socket between the health check and the send,
+		// that isn't the engine closing so try again on a fresh connection.
+		if((error == EPIPE || error == ECONNRESET) && reply.empty() && request->retry == false)
+		{
+			++_pool->reconnects;
+			request->retry = true;
+			--request->next;
+			SendChunk(request);
+			return;
 		}
-		catch(std::exception & e)
+
+		request->retry = false;
+
+		if(error)
 		{
-			_isClosed = true;
+			auto message = HandleError(error);
 
-			return Response{
-				.text= e.what(),
+			request->callback(Response{
+				.text= message? message : strerror(error),
 				.isError=true,
 				.isBinary=false,
-			};
+			});
+			return;
 		}
-	}
 
-	return Response{
-		.text= std::move(response),
-		.isError=false,
-		.isBinary=false,
-	};
-}
+		++_pool->closedByPeer;
+
+		if(request->response.empty())
+			request->response = std::move(reply);
+		else
+			request->response += reply;
 
+		SendChunk(request);
+	}, 60s, std::move(filter));
+}
 
 bool PosixSMI::isClosed()
 {
@@ -202,8 +397,188 @@ bool PosixSMI::isClosed()
 	return _isClosed;
 }
 
+std::string PosixSMI::GetStatistics()
+{
+	uint64_t hits = _pool->hits;
+	uint64_t misses = _pool->misses;
+	uint64_t reconnects = _pool->reconnects;
+	uint64_t total = hits + misses + reconnects;
+
+	char buffer[256];
+	snprintf(buffer, sizeof(buffer), "connections: %llu hit %llu miss %llu reconnect (%.1f%% hit rate), %llu closed by engine, %llu failed to connect\n",
+		(unsigned long long)hits, (unsigned long long)misses, (unsigned long long)reconnects,
+		total? 100.0 * hits / total : 0.0,
+		(unsigned long long)_pool->closedByPeer.load(), (unsigned long long)_pool->connectFailures.load());
+
+	return buffer;
+}
+
+
+#ifdef __linux__
+// the inode of whatever socket is listening on port, from /proc/net/tcp{,6}.
+static ino_t FindListeningInode(int port)
+{
+	enum { TCP_LISTEN = 0x0A };
+
+	for(auto path : { "/proc/net/tcp", "/proc/net/tcp6" })
+	{
+		FILE * file = fopen(path, "r");
+
+		if(file == nullptr)
+			continue;
+
+		char line[512];
+		ino_t inode = 0;
+
+	// first line is the column headers.
+		fgets(line, sizeof(line), file);
+
+		while(inode == 0 && fgets(line, sizeof(line), file))
+		{
+			// sl local_address rem_address st tx_queue:rx_queue tr:tm->when retrnsmt uid timeout inode
+			char local[128];
+			unsigned int state;
+			unsigned long number;
+
+			if(sscanf(line, "%*d: %127s %*s %x %*s %*s %*s %*d %*d %lu", local, &state, &number) != 3
+			|| state != TCP_LISTEN)
+				continue;
+
+			auto colon = strrchr(local, ':');
+
+			if(colon && strtol(colon+1, nullptr, 16) == port)
+				inode = number;
+		}
+
+		fclose(file);
+
+		if(inode)
+			return inode;
+	}
+
+	return 0;
+}
+
+static ino_t FindUnixInode(std::string_view path)
+{
+	FILE * file = fopen("/proc/net/unix", "r");
+
+	if(file == nullptr)
+		return 0;
+
+	char line[512 + PATH_MAX];
+	ino_t inode = 0;
+
+// first line is the column headers.
+	fgets(line, sizeof(line), file);
+
+	while(inode == 0 && fgets(line, sizeof(line), file))
+	{
+		// Num RefCount Protocol Flags Type St Inode Path
+		char name[PATH_MAX];
+		unsigned long number;
+
+		if(sscanf(line, "%*s %*s %*s %*s %*s %*s %lu %4095s", &number, name) == 2 && path == name)
+			inode = number;
+	}
+
+	fclose(file);
+	return inode;
+}
+
+// walk /proc/*/fd for the process holding the socket, skips anything we aren't allowed to look at.
+static pid_t FindSocketOwner(ino_t inode)
+{
+	char expected[64];
+	snprintf(expected, sizeof(expected), "socket:[%lu]", (unsigned long)inode);
+
+	DIR * proc = opendir("/proc");
+
+	if(proc == nullptr)
+		return 0;
+
+	pid_t pid = 0;
+
+	for(dirent * process; pid == 0 && (process = readdir(proc)); )
+	{
+		char * end;
+		long id = strtol(process->d_name, &end, 10);
+
+		if(*end || id <= 0)
+			continue;
+
+		char path[PATH_MAX];
+		snprintf(path, sizeof(path), "/proc/%ld/fd", id);
+
+		DIR * fds = opendir(path);
+
+		if(fds == nullptr)
+			continue;
+
+		for(dirent * fd; pid == 0 && (fd = readdir(fds)); )
+		{
+			char link[PATH_MAX];
+			char target[64];
+			snprintf(link, sizeof(link), "/proc/%ld/fd/%s", id, fd->d_name);
+
+			auto length = readlink(link, target, sizeof(target)-1);
+
+			if(length > 0)
+			{
+				target[length] = 0;
+
+				if(strcmp(target, expected) == 0)
+					pid = id;
+			}
+		}
+
+		closedir(fds);
+	}
+
+	closedir(proc);
+	return pid;
+}
+#endif
 
 pid_t PosixSMI::GetPid(int port)
+{
+#ifdef __linux__
+	static std::mutex mutex;
+	static std::map<std::pair<int, ino_t>, pid_t> cache;
+
+	if(auto inode = FindListeningInode(port))
+	{
+		std::lock_guard lock(mutex);
+		auto key = std::make_pair(port, inode);
+		auto itr = cache.find(key);
+
+	// same port, same socket, and the process is still there: it's the same engine.
+		if(itr != cache.end() && (kill(itr->second, 0) == 0 || errno != ESRCH))
+			return itr->second;
+
+		if(auto pid = FindSocketOwner(inode))
+			return cache[key] = pid;
+	}
+#endif
+
+	return GetPidFromLsof(port);
+}
+
+pid_t PosixSMI::Transport::GetPid() const
+{
+	if(port)
+		return PosixSMI::GetPid(port);
+
+#ifdef __linux__
+	if(auto inode = FindUnixInode(((sockaddr_un const&)address).sun_path))
+		return FindSocketOwner(inode);
+#endif
+
+	return 0;
+}
+
+// macOS has no /proc, and on linux we may not be allowed to see the engine's fds.
+pid_t PosixSMI::GetPidFromLsof(int port)
 {
 	auto exec = [](const char* cmd) -> std::string {
 		std::array<char, 128> buffer;
@@ -228,38 +603,19 @@ pid_t PosixSMI::GetPid(int port)
 	return pid;
 }
 
+// timeouts are enforced by the reactor now, the socket itself never blocks, not even to connect.
 PosixSMI::Socket::Socket(PosixSMI &parent) :
+	_socket(parent._transport->Connect()),
 	parent(parent)
 {
-	sockaddr_in& serv_addr = parent.serv_addr;
-
-	// Create socket
-	if ((_socket = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-		throw std::runtime_error("Socket creation error: " + std::string(strerror(errno)));
-	}
-
-	// Connect to the server
-	if (connect(_socket, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
-
-		close(_socket);
-		throw std::runtime_error("Connection failed: " + std::string(strerror(errno)));
-	}
-
-	int _enable{1};
-
-	struct timeval timeout;
-	memset(&timeout, 0, sizeof(timeout));
-	timeout.tv_sec = 60;  // 0 seconds
-	timeout.tv_usec = 0; // 100 miliseconds
-
-	setsockopt(_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
-	setsockopt(_socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
-	setsockopt(_socket, SOL_SOCKET, SO_REUSEADDR, &_enable, sizeof(_enable));
 }
 
 
 PosixSMI::Socket::~Socket()
 {
+	if(_socket < 0)
+		return;
+
 	auto error = close(_socket);
 
 	if(error < 0)
@@ -278,27 +634,21 @@ PosixSMI::Socket::~Socket()
 	}
 }
 
-std::string_view PosixSMI::Socket::read_message(const char *& error)
+bool PosixSMI::Socket::isAlive()
 {
-	errno = 0;
-	static char buffer[BUFFER_SIZE];
-	auto length = recv(_socket, buffer, sizeof(buffer), MSG_NOSIGNAL);
+	char c;
+	auto length = recv(_socket, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+	bool alive = length < 0 && (errno == EWOULDBLOCK || errno == EAGAIN);
 
-	if(length > 0)
-	{
-		return std::string_view(buffer, length);
-	}
-	else if(length != 0)
-	{
-		error = HandleError();
-	}
-
-	if(errno)
-	{
-		HandleError();
-	}
+	errno = 0;
+	return alive;
+}
 
-	return {};
+int PosixSMI::Socket::release()
+{
+	int fd = _socket;
+	_socket = -1;
+	return fd;
 }
 
 const char * PosixSMI::Socket::HandleError()
@@ -306,41 +656,134 @@ const char * PosixSMI::Socket::HandleError()
 	auto error = errno;
 	errno = 0;
 
+	switch(error)
+	{
+		case EBADF:
+			throw std::logic_error("socket not a valid file descriptor?");
+		case ENOTCONN:
+			throw std::logic_error("socket not connected?");
+		case ENOTSOCK:
+			throw std::logic_error("socket not a socket?");
+		case EOPNOTSUPP:
+			throw std::logic_error("flags not supported.");
+	}
+
+	return parent.HandleError(error);
+}
+
+// runs on the reactor thread, so report everything rather than throwing.
+const char * PosixSMI::HandleError(int error)
+{
 	switch(error)
 	{
 		case EWOULDBLOCK:
 			break;
 		case EBADF:
-			throw std::logic_error("socket not a valid file descriptor?");
+			return "socket not a valid file descriptor?";
 		case ECONNRESET:
-			parent._isClosed = true;
+			_isClosed = true;
 			return "Connection reset by host";
 			break;
 		case EINTR:
-			parent._isClosed = true;
+			_isClosed = true;
 			return "Caught signal";
 			break;
 		case EPIPE:
-			parent._isClosed = true;
+			_isClosed = true;
 			_connectionReset = true;
 			return 	"Connection reset by peer";
 		case EINVAL:
-			parent._isClosed = true;
+			_isClosed = true;
 			return "No out of band data available";
 			break;
 		case ENOTCONN:
-			throw std::logic_error("socket not connected?");
+			return "socket not connected?";
 		case ENOTSOCK:
-			throw std::logic_error("socket not a socket?");
+			return "socket not a socket?";
 		case EOPNOTSUPP:
-			throw std::logic_error("flags not supported.");
+			return "flags not supported.";
 		case ETIMEDOUT:
-			parent._timeout = true;
-			break;
+			_timeout = true;
+			return "Timed out waiting for the engine to reply.";
+		case ECANCELED:
+			return "Engine connection closed before it replied.";
+		case ECONNREFUSED:
+			_isClosed = true;
+			++_pool->connectFailures;
+			return "Connection refused";
 	}
 
 	return nullptr;
 }
 
+std::unique_ptr<PosixSMI::Socket> PosixSMI::ConnectionPool::acquire()
+{
+	bool replaced = false;
+
+	{
+		std::lock_guard lock(_mutex);
+
+		while(_idle.size())
+		{
+			auto socket = std::move(_idle.back());
+			_idle.pop_back();
+
+			if(socket->isAlive())
+			{
+				++hits;
+				return socket;
+			}
+
+			replaced = true;
+		}
+	}
+
+	++(replaced? reconnects : misses);
+
+	try
+	{
+		return std::unique_ptr<Socket>(new Socket(parent));
+	}
+	catch(std::exception &)
+	{
+		++connectFailures;
+		throw;
+	}
+}
+
+// connect ahead of time so the next request finds a socket waiting for it.
+void PosixSMI::ConnectionPool::prime()
+{
+	if(parent._isClosed)
+		return;
+
+	std::unique_lock lock(_mutex);
+
+	while(_idle.size() < WarmConnections)
+	{
+		lock.unlock();
+
+		std::unique_ptr<Socket> socket;
+
+		try
+		{
+			socket.reset(new Socket(parent));
+		}
+		catch(std::exception &)
+		{
+			++connectFailures;
+			return;
+		}
+
+		lock.lock();
+		_idle.push_back(std::move(socket));
+	}
+}
+
+void PosixSMI::ConnectionPool::clear()
+{
+	std::lock_guard lock(_mutex);
+	_idle.clear();
+}
 
 #endif
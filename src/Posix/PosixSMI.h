@@ -2,30 +2,78 @@
 #include "../SharedMemoryInterface.h"
 
 #ifndef _WIN32
+#include "PosixReactor.h"
+#include "../Cp1252.h"
 #include <netinet/in.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <filesystem>
+#include <mutex>
+#include <vector>
 
 
 class PosixSMI : public SharedMemoryInterface
 {
 public:
-	static std::unique_ptr<SharedMemoryInterface> Create();
+struct Transport;
+	static std::unique_ptr<SharedMemoryInterface> Create(IsOpen const& isOpen);
+// the engine writes the port it listens on here when it starts.
+	static std::filesystem::path const& GetPortFile();
 
-	PosixSMI(sockaddr_in & serv_addr, int port);
+	PosixSMI(Transport const& transport);
 	~PosixSMI();
 
-	Response send1252(std::string &) override;
+	Response send1252(std::string_view) override;
+	Response send1252(Script const&) override;
+	void send1252Async(Script, Callback) override;
 	bool isClosed() override;
 
+	std::string GetStatistics() override;
+
+// who is listening on port: from /proc on linux, otherwise (or if we can't see it there) lsof; 0 if neither can tell.
+	static pid_t GetPid(int port);
+	static pid_t GetPidFromLsof(int port);
 
 private:
 struct Socket;
-	static pid_t GetPid(int port);
+struct ConnectionPool;
+struct Request;
 	static int _connectionReset;
 
-	sockaddr_in serv_addr;
+	Response Wait(std::shared_ptr<Request> request);
+	void Submit(std::shared_ptr<Request> request);
+	void SendChunk(std::shared_ptr<Request> request);
+	const char * HandleError(int error);
+
+	std::unique_ptr<Transport> _transport;
 	pid_t _pid{};
-	bool _isClosed{false};
-	bool _timeout{false};
+	std::atomic<bool> _isClosed{false};
+	std::atomic<bool> _timeout{false};
+
+	std::unique_ptr<PosixReactor> _reactor;
+	std::unique_ptr<ConnectionPool> _pool;
+};
+
+// how to reach the engine: tcp on loopback, or a unix domain socket when the engine
+// (or a shim sitting next to it) offers one, which skips the tcp stack altogether.
+// the port file holds either a port number or unix:/path/to/socket.
+struct PosixSMI::Transport
+{
+	static Transport Tcp(int port);
+	static Transport Unix(std::string_view path);
+// empty if the text isn't something we know how to connect to.
+	static std::unique_ptr<Transport> Parse(std::string_view text);
+
+// non-blocking connect, throws if it fails straight away; otherwise the reactor finds out.
+	int Connect() const;
+// whoever is listening, 0 if we can't tell.
+	pid_t GetPid() const;
+
+	sockaddr_storage address{};
+	socklen_t length{};
+	int port{};
+// 127.0.0.1:port or unix:path, what the engine is known by.
+	std::string name;
 };
 
 struct PosixSMI::Socket
@@ -33,11 +81,67 @@ struct PosixSMI::Socket
 	Socket(PosixSMI & parent);
 	~Socket();
 
-	std::string_view read_message(const char *& error);
+// false if the engine hung up (or sent something we didn't ask for) while the socket sat idle.
+	bool isAlive();
+
+// hand the descriptor over to someone else (the reactor), we won't close it.
+	int release();
+
 	const char * HandleError();
 
 	int _socket{};
 	PosixSMI & parent;
 };
 
+// keeps connected sockets to the engine around so a request doesn't have to pay for
+// socket() + connect() + setsockopt() every time.
+// the engine hangs up once it has answered a script, so sockets go to the reactor and
+// don't come back; a fresh one is connected ahead of the next request instead.
+// the warm one is left open for as long as it takes the next request to come along, on
+// purpose: the debug log is polled at least every POLL_MAX (EngineRegistry.cpp) so it is never idle for long,
+// and if the engine drops it in the meantime acquire() sees that and connects another.
+struct PosixSMI::ConnectionPool
+{
+	enum
+	{
+		WarmConnections = 1,
+	};
+
+	ConnectionPool(PosixSMI & parent) : parent(parent) {}
+
+	std::unique_ptr<Socket> acquire();
+	void prime();
+	void clear();
+
+	PosixSMI & parent;
+
+	std::mutex _mutex;
+	std::vector<std::unique_ptr<Socket>> _idle;
+
+	std::atomic<uint64_t> hits{};
+	std::atomic<uint64_t> misses{};
+	std::atomic<uint64_t> reconnects{};
+	std::atomic<uint64_t> closedByPeer{};
+	std::atomic<uint64_t> connectFailures{};
+};
+
+struct PosixSMI::Request
+{
+// message is either a view of owned, or of the caller's buffer when they wait for the reply.
+// script is set when we were told where it can be cut up.
+	Script owned;
+	Script const* script{};
+	std::string_view message;
+	std::vector<std::string_view> chunks;
+	size_t next{};
+	bool retry{};
+
+// replies to scripts are turned into utf8 a block at a time as they come in.
+	bool decode{};
+	Utf8FromCp1252Stream stream;
+
+	std::string response;
+	Callback callback;
+};
+
 #endif
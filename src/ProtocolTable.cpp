@@ -0,0 +1,128 @@
+#include "ProtocolTable.h"
+#include <algorithm>
+
+enum
+{
+	INITIAL_SIZE = 16,
+};
+
+// fnv-1a, protocol names are short.
+uint32_t ProtocolTable::Hash(std::string_view name)
+{
+	uint32_t hash = 2166136261u;
+
+	for(unsigned char c : name)
+		hash = (hash ^ c) * 16777619u;
+
+	return hash;
+}
+
+uint32_t ProtocolTable::find(std::string_view protocol) const
+{
+	if(_index.empty())
+		return npos;
+
+	auto mask = _index.size() - 1;
+
+	for(auto i = Hash(protocol) & mask; _index[i]; i = (i + 1) & mask)
+	{
+		if(_names[_index[i] - 1] == protocol)
+			return _index[i] - 1;
+	}
+
+	return npos;
+}
+
+uint32_t ProtocolTable::intern(std::string_view protocol)
+{
+	auto id = find(protocol);
+
+	if(id != npos)
+		return id;
+
+// no more than half full, so probes stay short.
+	if((_names.size() + 1) * 2 > _index.size())
+		Grow();
+
+	id = uint32_t(_names.size());
+	_names.emplace_back(protocol);
+	_members.emplace_back();
+
+	auto mask = _index.size() - 1;
+	auto i = Hash(protocol) & mask;
+
+	while(_index[i])
+		i = (i + 1) & mask;
+
+	_index[i] = id + 1;
+	return id;
+}
+
+void ProtocolTable::Grow()
+{
+	_index.assign(std::max<size_t>(INITIAL_SIZE, _index.size() * 2), 0);
+
+	auto mask = _index.size() - 1;
+
+	for(uint32_t id = 0; id < _names.size(); ++id)
+	{
+		auto i = Hash(_names[id]) & mask;
+
+		while(_index[i])
+			i = (i + 1) & mask;
+
+		_index[i] = id + 1;
+	}
+}
+
+bool ProtocolTable::add(uint32_t protocol, Socket const& socket)
+{
+	auto & slots = _slots[socket.get()];
+
+	for(auto & slot : slots)
+	{
+		if(slot.protocol == protocol)
+			return false;
+	}
+
+	slots.push_back(Slot{ .protocol = protocol, .index = uint32_t(_members[protocol].size()) });
+	_members[protocol].push_back(socket);
+	return true;
+}
+
+void ProtocolTable::remove(ix::WebSocket const* socket)
+{
+	auto itr = _slots.find(socket);
+
+	if(itr == _slots.end())
+		return;
+
+	for(auto & slot : itr->second)
+	{
+		auto & members = _members[slot.protocol];
+
+		if(slot.index + 1 != members.size())
+		{
+			members[slot.index] = std::move(members.back());
+
+		// tell the one we moved where it lives now.
+			for(auto & moved : _slots.find(members[slot.index].get())->second)
+			{
+				if(moved.protocol == slot.protocol)
+					moved.index = slot.index;
+			}
+		}
+
+		members.pop_back();
+	}
+
+	_slots.erase(itr);
+}
+
+void ProtocolTable::clear()
+{
+	for(auto & members : _members)
+		members.clear();
+
+	_slots.clear();
+}
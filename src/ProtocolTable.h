@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace ix {
+	class WebSocket;
+}
+
+// which sockets are listening on which subprotocol, for routing ws[protocol] lines.
+// - protocol names are interned once, after that a protocol is an index into a dense vector
+//   of its sockets, so sending to everyone is a walk over a vector.
+// - sockets are held until removed (when they close, fail, or are let go of), there is no lock()
+//   per message and nothing dead to skip over.
+// - removing a socket swaps the last one into its place, each socket remembers where it is.
+// not thread safe, the websocket server's lock covers it.
+class ProtocolTable
+{
+public:
+using Socket = std::shared_ptr<ix::WebSocket>;
+
+	enum : uint32_t { npos = UINT32_MAX };
+
+// the same name always gets the same id.
+	uint32_t intern(std::string_view protocol);
+// npos if nobody has used it yet.
+	uint32_t find(std::string_view protocol) const;
+
+// false if it was already there.
+	bool add(uint32_t protocol, Socket const& socket);
+	void remove(ix::WebSocket const* socket);
+	bool contains(ix::WebSocket const* socket) const { return _slots.count(socket) != 0; }
+	void clear();
+
+	std::vector<Socket> const& members(uint32_t protocol) const { return _members[protocol]; }
+
+private:
+	struct Slot
+	{
+		uint32_t protocol{};
+		uint32_t index{};
+	};
+
+	static uint32_t Hash(std::string_view);
+	void Grow();
+
+// open addressing, id + 1 so 0 is empty.
+	std::vector<uint32_t> _index;
+	std::vector<std::string> _names;
+	std::vector<std::vector<Socket>> _members;
+	std::unordered_map<ix::WebSocket const*, std::vector<Slot>> _slots;
+};
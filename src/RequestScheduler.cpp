@@ -0,0 +1,645 @@
+#include "RequestScheduler.h"
+#include "Support.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <future>
+
+using namespace std::chrono_literals;
+
+enum
+{
+// scripts at least this long are treated as installs rather than console commands.
+	BULK_THRESHOLD = 4096,
+// only queries shorter than this are batched together.
+	COALESCE_LIMIT = 512,
+	MAX_BATCH = 32,
+};
+
+// how long a request in each class can wait before it is served ahead of higher classes.
+static const RequestScheduler::Clock::duration g_patience[] =
+{
+	RequestScheduler::Clock::duration::max(),
+	250ms,
+	1000ms,
+};
+
+const char * RequestScheduler::GetName(Priority priority)
+{
+	switch(priority)
+	{
+	case Priority::Interactive: return "interactive";
+	case Priority::Background:	return "background";
+	case Priority::Bulk:		return "bulk";
+	default:					return "unknown";
+	}
+}
+
+// word must be lower case.
+static bool Contains(std::string_view caos, std::string_view word)
+{
+	auto itr = std::search(caos.begin(), caos.end(), word.begin(), word.end(), [](char a, char b)
+	{
+		return std::tolower((unsigned char)a) == b;
+	});
+
+	return itr != caos.end();
+}
+
+static std::string GetMarker(uint64_t batch, size_t i)
+{
+	return "@@ns" + std::to_string(batch) + "." + std::to_string(i) + "@@";
+}
+
+RequestScheduler::Priority RequestScheduler::Classify(std::string_view caos)
+{
+	if(caos.size() >= BULK_THRESHOLD)
+		return Priority::Bulk;
+
+	return Contains(caos, "scrp")? Priority::Bulk : Priority::Interactive;
+}
+
+bool RequestScheduler::CanCoalesce(std::string_view caos)
+{
+	caos = TrimWhitespace(caos);
+
+	if(caos.size() < 4 || caos.size() > COALESCE_LIMIT)
+		return false;
+
+	auto lower = [](char c) { return (char)std::tolower((unsigned char)c); };
+
+	if(lower(caos[0]) != 'o' || lower(caos[1]) != 'u' || lower(caos[2]) != 't')
+		return false;
+
+	if(lower(caos[3]) != 'v' && lower(caos[3]) != 's' && lower(caos[3]) != 'x')
+		return false;
+
+	if(caos.size() > 4 && isWhitespace(caos[4]) == false)
+		return false;
+
+	return !Contains(caos, "scrp") && !Contains(caos, "endm") && !Contains(caos, "rscr") && !Contains(caos, "@@ns");
+}
+
+RequestScheduler::RequestScheduler(SharedMemoryInterface * interface, int maxInFlight) :
+	_interface(interface),
+	_maxInFlight(std::max(1, maxInFlight))
+{
+}
+
+RequestScheduler::~RequestScheduler()
+{
+	std::vector<Item> pending;
+	std::vector<Waiter> waiters;
+
+	{
+		std::lock_guard lock(_mutex);
+		_closing = true;
+
+		for(auto & queues : _queues)
+		{
+			for(auto & queue : queues)
+			{
+				for(auto & item : queue.second)
+					pending.push_back(std::move(item));
+			}
+
+			queues.clear();
+		}
+
+		for(auto & turns : _turns)
+			turns.clear();
+
+		for(auto & item : _retry)
+			pending.push_back(std::move(item));
+
+		_retry.clear();
+
+	// whoever is waiting on one that never went out won't hear from it; the rest are answered when theirs comes back.
+		for(auto & item : pending)
+		{
+			if(item.leader == false)
+				continue;
+
+			auto itr = _flights.find(item.cacheKey);
+
+			for(auto & waiter : itr->second.waiters)
+				waiters.push_back(std::move(waiter));
+
+			_flights.erase(itr);
+		}
+	}
+
+// nothing is left to go to the engine, tell everyone rather than leaving them waiting (send() would never return).
+	Response closing{
+		.text = "Game is closing.",
+		.isError = true,
+		.isBinary = false,
+	};
+
+	for(auto & item : pending)
+		item.callback(Response(closing));
+
+	for(auto & waiter : waiters)
+		waiter.callback(Response(closing));
+
+// the engine still has our completions, wait for them to come back.
+	std::unique_lock lock(_mutex);
+	_idle.wait(lock, [this]() { return _handlers == 0; });
+}
+
+void RequestScheduler::submit(ClientId client, Priority priority, std::string text, Callback callback)
+{
+	std::string cacheKey;
+	uint64_t cacheGeneration{};
+
+// the server's own requests (polling the debug log) don't touch the cache either way.
+	if(client != nullptr)
+	{
+		cacheKey = ResponseCache::GetKey(text, Caos::GetDialect(*_interface));
+
+		if(cacheKey.empty())
+		{
+			cache.invalidate();
+		}
+		else
+		{
+			Response cached;
+
+			if(cache.find(cacheKey, cached))
+			{
+				callback(std::move(cached));
+				return;
+			}
+
+			cacheGeneration = cache.generation();
+		}
+	}
+
+	std::unique_lock lock(_mutex);
+
+	if(_closing)
+	{
+		lock.unlock();
+
+		callback(Response{
+			.text = "Game is closing.",
+			.isError = true,
+			.isBinary = false,
+		});
+		return;
+	}
+
+	bool leader = false;
+
+	if(cacheKey.size())
+	{
+		auto [itr, inserted] = _flights.try_emplace(cacheKey, Flight{ .generation = cacheGeneration });
+
+	// something was sent since the one in flight went out, its answer might be out of date.
+		if(inserted == false && itr->second.generation == cacheGeneration)
+		{
+			itr->second.waiters.push_back(Waiter{
+				.client = client,
+				.callback = std::move(callback),
+			});
+
+			++_deduplicated;
+			return;
+		}
+
+		leader = inserted;
+	}
+
+	++_metrics[(int)priority].submitted;
+
+	Enqueue(Item{
+		.client = client,
+		.priority = priority,
+		.text = std::move(text),
+		.callback = std::move(callback),
+		.queued = Clock::now(),
+		.cacheKey = std::move(cacheKey),
+		.cacheGeneration = cacheGeneration,
+		.leader = leader,
+	});
+
+	lock.unlock();
+	Pump();
+}
+
+void RequestScheduler::Enqueue(Item item)
+{
+	auto & queue = _queues[(int)item.priority][item.client];
+
+	if(queue.empty())
+		_turns[(int)item.priority].push_back(item.client);
+
+	auto & metrics = _metrics[(int)item.priority];
+	metrics.maxDepth = std::max(metrics.maxDepth, ++metrics.depth);
+
+	queue.push_back(std::move(item));
+}
+
+// an item is going away without being answered; if others were waiting on it the first of them takes its place.
+// true if one did, it goes back in the queue as the same request rather than a new one.
+bool RequestScheduler::Dropped(Item & item)
+{
+	if(item.leader == false)
+		return false;
+
+	auto itr = _flights.find(item.cacheKey);
+
+	if(itr->second.waiters.empty())
+	{
+		_flights.erase(itr);
+		return false;
+	}
+
+	auto & waiters = itr->second.waiters;
+	auto waiter = std::move(waiters.front());
+	waiters.erase(waiters.begin());
+
+	item.client = waiter.client;
+	item.callback = std::move(waiter.callback);
+	Enqueue(std::move(item));
+	return true;
+}
+
+RequestScheduler::Response RequestScheduler::send(ClientId client, Priority priority, std::string const& text)
+{
+	std::promise<Response> promise;
+	auto future = promise.get_future();
+
+	submit(client, priority, text, [&promise](Response r)
+	{
+		promise.set_value(std::move(r));
+	});
+
+	return future.get();
+}
+
+void RequestScheduler::drop(ClientId client)
+{
+	std::unique_lock lock(_mutex);
+
+	for(auto & flight : _flights)
+		std::erase_if(flight.second.waiters, [client](Waiter const& waiter) { return waiter.client == client; });
+
+	std::vector<Item> dropped;
+
+	for(int c = 0; c < (int)Priority::Count; ++c)
+	{
+		auto itr = _queues[c].find(client);
+
+		if(itr == _queues[c].end())
+			continue;
+
+		_metrics[c].depth -= itr->second.size();
+
+		for(auto & item : itr->second)
+			dropped.push_back(std::move(item));
+
+		_queues[c].erase(itr);
+
+		std::erase(_turns[c], client);
+	}
+
+// these were counted as served when they first went out.
+	size_t queued = dropped.size();
+
+	for(auto itr = _retry.begin(); itr != _retry.end(); )
+	{
+		if(itr->client != client)
+		{
+			++itr;
+			continue;
+		}
+
+		dropped.push_back(std::move(*itr));
+		itr = _retry.erase(itr);
+	}
+
+	bool requeued = false;
+
+	for(size_t i = 0; i < dropped.size(); ++i)
+	{
+		if(Dropped(dropped[i]))
+			requeued = true;
+		else if(i < queued)
+			++_metrics[(int)dropped[i].priority].dropped;
+	}
+
+	lock.unlock();
+
+	if(requeued)
+		Pump();
+}
+
+void RequestScheduler::Pump()
+{
+	std::unique_lock lock(_mutex);
+
+// someone else is already dispatching, they'll pick up whatever we would have.
+	if(_pumping)
+		return;
+
+	_pumping = true;
+
+	while(_inFlight < _maxInFlight)
+	{
+		std::vector<Item> batch;
+		auto now = Clock::now();
+
+		if(_retry.size())
+		{
+			batch.push_back(std::move(_retry.front()));
+			_retry.pop_front();
+		}
+		else
+		{
+			bool promoted{};
+			int c = NextClass(now, &promoted);
+
+			if(c < 0)
+				break;
+
+			batch.push_back(PopFrom(c, now, promoted));
+
+			if(_interface->isDDE() == false && CanCoalesce(batch.front().text))
+			{
+				while(batch.size() < MAX_BATCH)
+				{
+					c = NextClass(now, &promoted);
+
+					if(c < 0 || CanCoalesce(Peek(c).text) == false)
+						break;
+
+					batch.push_back(PopFrom(c, now, promoted));
+				}
+			}
+		}
+
+		++_inFlight;
+		++_handlers;
+		lock.unlock();
+
+		Dispatch(std::move(batch));
+
+		lock.lock();
+	}
+
+	_pumping = false;
+}
+
+void RequestScheduler::Dispatch(std::vector<Item> batch)
+{
+	auto dispatched = Clock::now();
+	uint64_t id{};
+	std::string text;
+
+	if(batch.size() == 1)
+	{
+		text = std::move(batch.front().text);
+	}
+	else
+	{
+		{
+			std::lock_guard lock(_mutex);
+			id = ++_batches;
+			_coalesced += batch.size();
+		}
+
+		for(size_t i = 0; i < batch.size(); ++i)
+		{
+			text += batch[i].text;
+			text += "\nouts \"";
+			text += GetMarker(id, i);
+			text += "\"\n";
+		}
+	}
+
+	auto shared = std::make_shared<std::vector<Item>>(std::move(batch));
+
+	Callback done = [this, shared, id, dispatched](Response r)
+	{
+		{
+			std::lock_guard lock(_mutex);
+			--_inFlight;
+		}
+
+		if(shared->size() == 1)
+			Complete(shared->front(), std::move(r), dispatched);
+		else
+			OnBatchReply(*shared, id, std::move(r), dispatched);
+
+		Pump();
+
+	// last thing we touch, the destructor may be waiting on this.
+		std::lock_guard lock(_mutex);
+		--_handlers;
+		_idle.notify_all();
+	};
+
+	try
+	{
+		_interface->sendAsync(text, done);
+	}
+	catch(std::exception & e)
+	{
+		done(Response{
+			.text = e.what(),
+			.isError = true,
+			.isBinary = false,
+		});
+	}
+}
+
+void RequestScheduler::OnBatchReply(std::vector<Item> & batch, uint64_t id, Response && response, Clock::time_point dispatched)
+{
+	if(response.isError)
+	{
+		for(auto & item : batch)
+			Complete(item, Response(response), dispatched);
+
+		return;
+	}
+
+	std::string_view reply = response.text;
+	size_t pos = 0;
+	size_t i = 0;
+
+	for(; i < batch.size(); ++i)
+	{
+		auto marker = GetMarker(id, i);
+		auto end = reply.find(marker, pos);
+
+		if(end == std::string_view::npos)
+			break;
+
+		Complete(batch[i], Response{
+			.text = std::string(reply.substr(pos, end - pos)),
+			.isError = false,
+			.isBinary = response.isBinary,
+			.isAscii = response.isAscii,
+		}, dispatched);
+
+		pos = end + marker.size();
+	}
+
+	if(i == batch.size())
+		return;
+
+// the engine stopped part way through, what's left over is the error from the script that stopped it.
+// if nothing ran at all it probably didn't compile, and we can't tell whose fault that is.
+	if(i > 0)
+	{
+		Complete(batch[i], Response{
+			.text = std::string(reply.substr(pos)),
+			.isError = false,
+			.isBinary = response.isBinary,
+			.isAscii = response.isAscii,
+		}, dispatched);
+
+		++i;
+	}
+
+	{
+		std::lock_guard lock(_mutex);
+		++_batchFailures;
+
+		for(; i < batch.size(); ++i)
+			_retry.push_back(std::move(batch[i]));
+	}
+}
+
+void RequestScheduler::Complete(Item & item, Response && response, Clock::time_point dispatched)
+{
+	{
+		std::lock_guard lock(_mutex);
+		auto & metrics = _metrics[(int)item.priority];
+		++metrics.completed;
+		metrics.totalService += Clock::now() - dispatched;
+	}
+
+	std::vector<Waiter> waiters;
+
+	if(item.leader)
+	{
+		std::lock_guard lock(_mutex);
+		auto itr = _flights.find(item.cacheKey);
+		waiters = std::move(itr->second.waiters);
+		_flights.erase(itr);
+	}
+
+// the engine's own errors come back as ordinary replies, they'd be handed out for the whole ttl.
+	if(item.cacheKey.size() && response.isError == false && Caos::IsErrorReply(response.text) == false)
+		cache.insert(std::move(item.cacheKey), response, item.cacheGeneration);
+
+	for(auto & waiter : waiters)
+		waiter.callback(Response(response));
+
+	item.callback(std::move(response));
+}
+
+int RequestScheduler::NextClass(Clock::time_point now, bool * promoted)
+{
+	int chosen = -1;
+
+// anything that has waited past its class' patience cuts in line.
+	for(int c = 1; chosen < 0 && c < (int)Priority::Count; ++c)
+	{
+		for(auto & queue : _queues[c])
+		{
+			if(now - queue.second.front().queued > g_patience[c])
+			{
+				chosen = c;
+				break;
+			}
+		}
+	}
+
+	if(promoted)
+	{
+		*promoted = false;
+
+		for(int c = 0; chosen >= 0 && c < chosen; ++c)
+		{
+			if(_turns[c].size())
+				*promoted = true;
+		}
+	}
+
+	for(int c = 0; chosen < 0 && c < (int)Priority::Count; ++c)
+	{
+		if(_turns[c].size())
+			chosen = c;
+	}
+
+	return chosen;
+}
+
+RequestScheduler::Item const& RequestScheduler::Peek(int priority)
+{
+	return _queues[priority].find(_turns[priority].front())->second.front();
+}
+
+RequestScheduler::Item RequestScheduler::PopFrom(int priority, Clock::time_point now, bool promoted)
+{
+	auto client = _turns[priority].front();
+	_turns[priority].pop_front();
+
+	auto itr = _queues[priority].find(client);
+	auto & queue = itr->second;
+
+	Item item = std::move(queue.front());
+	queue.pop_front();
+
+	if(queue.empty())
+		_queues[priority].erase(itr);
+	else
+		_turns[priority].push_back(client);
+
+	auto & metrics = _metrics[priority];
+	auto wait = now - item.queued;
+
+	--metrics.depth;
+	metrics.promoted += promoted;
+	metrics.totalWait += wait;
+	metrics.maxWait = std::max(metrics.maxWait, wait);
+
+	return item;
+}
+
+std::string RequestScheduler::GetStatistics()
+{
+	auto ms = [](Clock::duration d)
+	{
+		return std::chrono::duration<double, std::milli>(d).count();
+	};
+
+	std::lock_guard lock(_mutex);
+	std::string result;
+
+	for(int c = 0; c < (int)Priority::Count; ++c)
+	{
+		auto & metrics = _metrics[c];
+		auto served = metrics.submitted - metrics.depth - metrics.dropped;
+
+		char buffer[256];
+		snprintf(buffer, sizeof(buffer), "scheduler %s: %zu queued (max %zu), %llu done, %llu dropped, %llu promoted, wait avg %.2fms max %.2fms, engine avg %.2fms\n",
+			GetName(Priority(c)), metrics.depth, metrics.maxDepth,
+			(unsigned long long)metrics.completed, (unsigned long long)metrics.dropped, (unsigned long long)metrics.promoted,
+			served? ms(metrics.totalWait) / served : 0.0, ms(metrics.maxWait),
+			metrics.completed? ms(metrics.totalService) / metrics.completed : 0.0);
+
+		result += buffer;
+	}
+
+	char buffer[256];
+	snprintf(buffer, sizeof(buffer), "scheduler coalesced: %llu requests in %llu scripts, %llu scripts stopped part way, %llu answered by one already in flight\n",
+		(unsigned long long)_coalesced, (unsigned long long)_batches, (unsigned long long)_batchFailures, (unsigned long long)_deduplicated);
+
+	result += buffer;
+	result += cache.GetStatistics();
+	return result;
+}
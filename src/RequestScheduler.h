@@ -0,0 +1,135 @@
+#pragma once
+#include "SharedMemoryInterface.h"
+#include "ResponseCache.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// sits in front of SharedMemoryInterface so every client gets a turn at the engine.
+// - each client has its own queue per priority class, clients are served round robin.
+// - higher classes go first, but anything that has waited longer than its class'
+//   patience jumps the queue so polling and installs can't be starved outright.
+// - small read-only queries waiting together (outv/outs/outx on c2e) go to the engine
+//   as one script with a marker after each, and the reply is split back up.
+// - replies to read-only queries are cached for a moment, see ResponseCache.
+// - a read-only query that is already queued or running doesn't go again, whoever else
+//   asked for it gets a copy of its reply.
+class RequestScheduler
+{
+public:
+using Response = SharedMemoryInterface::Response;
+using Callback = SharedMemoryInterface::Callback;
+using Clock = std::chrono::steady_clock;
+// opaque, only compared; the websocket a request came from or nullptr for the server itself.
+using ClientId = const void*;
+
+	enum class Priority
+	{
+		Interactive,
+		Background,
+		Bulk,
+
+		Count
+	};
+
+	static const char * GetName(Priority);
+// guess what a webapp's script is for: big scripts and agent installs are bulk.
+	static Priority Classify(std::string_view caos);
+// small output queries that are safe to run back to back in one script.
+	static bool CanCoalesce(std::string_view caos);
+
+	RequestScheduler(SharedMemoryInterface * interface, int maxInFlight = 1);
+	~RequestScheduler();
+
+	void submit(ClientId client, Priority priority, std::string text, Callback callback);
+	Response send(ClientId client, Priority priority, std::string const& text);
+
+// client went away, forget whatever it still had queued.
+	void drop(ClientId client);
+
+	std::string GetStatistics();
+
+	SharedMemoryInterface * _interface{};
+	ResponseCache cache;
+
+private:
+	struct Item
+	{
+		ClientId client{};
+		Priority priority{};
+		std::string text;
+		Callback callback;
+		Clock::time_point queued;
+	// empty if the reply isn't to be cached.
+		std::string cacheKey;
+		uint64_t cacheGeneration{};
+	// others are waiting on this reply.
+		bool leader{};
+	};
+
+	struct Waiter
+	{
+		ClientId client{};
+		Callback callback;
+	};
+
+// the same query asked again while it is queued or running.
+	struct Flight
+	{
+		uint64_t generation{};
+		std::vector<Waiter> waiters{};
+	};
+
+	struct Metrics
+	{
+		uint64_t submitted{};
+		uint64_t completed{};
+		uint64_t dropped{};
+		uint64_t promoted{};
+
+		size_t depth{};
+		size_t maxDepth{};
+
+		Clock::duration totalWait{};
+		Clock::duration maxWait{};
+		Clock::duration totalService{};
+	};
+
+	void Pump();
+	int NextClass(Clock::time_point now, bool * promoted = nullptr);
+	Item const& Peek(int priority);
+	Item PopFrom(int priority, Clock::time_point now, bool promoted);
+	void Dispatch(std::vector<Item> batch);
+	void OnBatchReply(std::vector<Item> & batch, uint64_t id, Response && response, Clock::time_point dispatched);
+	void Complete(Item & item, Response && response, Clock::time_point dispatched);
+	void Enqueue(Item item);
+	bool Dropped(Item & item);
+
+	std::mutex _mutex;
+	std::condition_variable _idle;
+
+	std::map<ClientId, std::deque<Item>> _queues[(int)Priority::Count];
+	std::deque<ClientId> _turns[(int)Priority::Count];
+	Metrics _metrics[(int)Priority::Count];
+
+// left over from a batch the engine gave up on part way, these go next and alone.
+	std::deque<Item> _retry;
+// keyed by cacheKey, only one item with a key leads at a time.
+	std::unordered_map<std::string, Flight> _flights;
+	uint64_t _deduplicated{};
+	uint64_t _batches{};
+	uint64_t _coalesced{};
+	uint64_t _batchFailures{};
+
+	int _maxInFlight{1};
+	int _inFlight{};
+	int _handlers{};
+	bool _pumping{};
+	bool _closing{};
+};
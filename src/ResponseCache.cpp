@@ -0,0 +1,131 @@
+#include "ResponseCache.h"
+#include <cstdio>
+
+using namespace std::chrono_literals;
+
+enum
+{
+// the cache only ever holds what is being polled right now, if it is this big something is off.
+	MAX_ENTRIES = 1024,
+};
+
+// two ticks on c2e, short enough that nobody should notice.
+static const ResponseCache::Clock::duration DEFAULT_TTL = 100ms;
+
+ResponseCache::ResponseCache() :
+	_ttl(DEFAULT_TTL)
+{
+}
+
+ResponseCache::Clock::duration ResponseCache::GetTickLength(Caos::Dialect dialect)
+{
+// c2e's buzz defaults to 50ms; the older engines ran at 10 ticks a second.
+	return dialect == Caos::Dialect::C2E? 50ms : 100ms;
+}
+
+std::string ResponseCache::GetKey(std::string_view caos, Caos::Dialect dialect)
+{
+	std::string key;
+
+	if(Caos::IsReadOnly(caos, dialect))
+		Caos::Minify(key, caos, dialect);
+
+	return key;
+}
+
+bool ResponseCache::find(std::string const& key, Response & response)
+{
+	std::lock_guard lock(_mutex);
+
+	auto itr = _entries.find(key);
+
+	if(itr == _entries.end())
+	{
+		++_misses;
+		return false;
+	}
+
+	if(itr->second.expires <= Clock::now())
+	{
+		_entries.erase(itr);
+		++_expired;
+		++_misses;
+		return false;
+	}
+
+	++_hits;
+	response = itr->second.response;
+	return true;
+}
+
+void ResponseCache::insert(std::string key, Response const& response, uint64_t generation)
+{
+	std::lock_guard lock(_mutex);
+
+	if(_ttl <= Clock::duration::zero() || generation != _generation)
+		return;
+
+	auto now = Clock::now();
+
+	if(_entries.size() >= MAX_ENTRIES)
+	{
+		std::erase_if(_entries, [now](auto const& item) { return item.second.expires <= now; });
+
+		if(_entries.size() >= MAX_ENTRIES)
+			return;
+	}
+
+	_entries.insert_or_assign(std::move(key), Entry{
+		.response = response,
+		.expires = now + _ttl,
+	});
+}
+
+void ResponseCache::invalidate()
+{
+	std::lock_guard lock(_mutex);
+	++_generation;
+
+	if(_entries.empty())
+		return;
+
+	_entries.clear();
+	++_invalidated;
+}
+
+uint64_t ResponseCache::generation()
+{
+	std::lock_guard lock(_mutex);
+	return _generation;
+}
+
+void ResponseCache::setTtl(Clock::duration ttl)
+{
+	std::lock_guard lock(_mutex);
+	_ttl = ttl;
+
+	if(_ttl <= Clock::duration::zero())
+		_entries.clear();
+}
+
+ResponseCache::Clock::duration ResponseCache::getTtl()
+{
+	std::lock_guard lock(_mutex);
+	return _ttl;
+}
+
+std::string ResponseCache::GetStatistics()
+{
+	std::lock_guard lock(_mutex);
+
+	auto lookups = _hits + _misses;
+
+	char buffer[256];
+	snprintf(buffer, sizeof(buffer), "cache: ttl %lldms, %zu entries, %llu hits, %llu misses (%.1f%% hit rate), %llu expired, %llu invalidated\n",
+		(long long)std::chrono::duration_cast<std::chrono::milliseconds>(_ttl).count(), _entries.size(),
+		(unsigned long long)_hits, (unsigned long long)_misses,
+		lookups? 100.0 * _hits / lookups : 0.0,
+		(unsigned long long)_expired, (unsigned long long)_invalidated);
+
+	return buffer;
+}
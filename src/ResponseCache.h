@@ -0,0 +1,61 @@
+#pragma once
+#include "SharedMemoryInterface.h"
+#include "Caos.h"
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// replies to read-only queries, so webapps polling the same thing from several tabs
+// don't each cost a trip to the engine.
+// - only scripts made entirely of words that can't change anything are kept (see Caos::IsReadOnly),
+//   keyed by their minified text so spacing and comments don't matter.
+// - an entry lives for the ttl; anything else a client sends might change what the
+//   answers would be, so it empties the cache.
+// - the ttl can be given in engine ticks, which are turned into time (the engines don't tell us theirs).
+class ResponseCache
+{
+public:
+using Response = SharedMemoryInterface::Response;
+using Clock = std::chrono::steady_clock;
+
+	ResponseCache();
+
+// how long a tick lasts when the engine is running normally.
+	static Clock::duration GetTickLength(Caos::Dialect);
+
+// the key to file caos under, empty if it shouldn't be cached.
+	static std::string GetKey(std::string_view caos, Caos::Dialect);
+
+// false if there's nothing, or nothing recent enough.
+	bool find(std::string const& key, Response & response);
+// generation is what it was when the query was sent, a reply that raced an invalidate isn't kept.
+	void insert(std::string key, Response const& response, uint64_t generation);
+// something that might change the world went to the engine.
+	void invalidate();
+	uint64_t generation();
+
+// 0 turns the cache off.
+	void setTtl(Clock::duration ttl);
+	Clock::duration getTtl();
+
+	std::string GetStatistics();
+
+private:
+	struct Entry
+	{
+		Response response;
+		Clock::time_point expires;
+	};
+
+	std::mutex _mutex;
+	std::unordered_map<std::string, Entry> _entries;
+	Clock::duration _ttl;
+	uint64_t _generation{};
+
+	uint64_t _hits{};
+	uint64_t _misses{};
+	uint64_t _expired{};
+	uint64_t _invalidated{};
+};
@@ -1,7 +1,12 @@
 #pragma once
+#include <atomic>
 #include <filesystem>
+#include <functional>
+#include <future>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 
 
 class SharedMemoryInterface
@@ -12,6 +17,10 @@ using pid_t = unsigned int;
 #endif
 
 struct Response;
+struct Script;
+using Callback = std::function<void(Response)>;
+// true if we are already talking to the engine at this address.
+using IsOpen = std::function<bool(std::string_view address)>;
 	enum
 	{
 		Creatures1Version = 20,
@@ -20,30 +29,52 @@ struct Response;
 	static std::string cp1252FromUtf8(std::string const&);
 	static std::string utf8FromCp1252(std::string const&);
 	static bool isAscii(std::string const&);
+// turns a reply from the engine into utf8 and sets isAscii, only the part after the
+// leading run of plain ascii is looked at twice.
+	static void decodeResponse(Response &);
 
-// CRLF to LF
+// utf8 to cp1252 and CR dropped, in one pass straight into out (whose buffers are reused).
 // if c1 is true:
 //	- strings use [] not ""
 //  - you cannot escape characters in a string (\] still ends the string). 
-//  - multiple whitespace characters in a row outside a string causes a crash.
-	static std::string cleanWhitespace(std::string &&, bool c1 = true);
+//  - multiple whitespace characters in a row outside a string causes a crash, so they're collapsed.
+	static void encodeScript(Script & out, std::string_view utf8, bool c1);
 
-	static std::unique_ptr<SharedMemoryInterface> Open();
+// finds an engine we aren't already talking to, or nullptr.
+	static std::unique_ptr<SharedMemoryInterface> Open(IsOpen isOpen = {});
 	virtual ~SharedMemoryInterface() = default;
 
+// scripts the engine can't run (see Caos::Validate) are answered with what's wrong rather than sent.
 	Response send(std::string const&);
 
-	virtual Response send1252(std::string &) = 0;
+// the callback may run on another thread (the engine's reactor on posix),
+// it must not block or call send() from there.
+	void sendAsync(std::string const&, Callback);
+	std::future<Response> sendAsync(std::string const&);
+
+	virtual Response send1252(std::string_view) = 0;
+// these know where the script can be split, default just sends the text.
+// the reply may come back already in utf8 (isUtf8 is set) if the backend can convert it as it arrives.
+	virtual Response send1252(Script const&);
+// default just calls send1252, so the callback has run by the time this returns.
+	virtual void send1252Async(Script, Callback);
 	virtual bool isClosed() = 0;
 
 
 // server commands SAVE/LOAD/etc won't work if these aren't defined.
 	virtual std::filesystem::path GetWorldDirectory() { return {}; }
 
+// human readable counters for the STAT command, one per line.
+	virtual std::string GetStatistics() { return {}; }
+// how much minifying saved, for every engine.
+	std::string GetScriptStatistics();
+
 	static std::filesystem::path GetWorkingDirectory(pid_t pid);
 
 	std::string _name;
 	std::string _engine;
+// how we reached it (shared memory name, port, ...), tells two running engines apart.
+	std::string _address;
 	int versionMajor{};
 	int versionMinor{};
 
@@ -52,6 +83,24 @@ struct Response;
 	bool isDDE() const { return _engine == "Vivarium"; }
 	bool isCreatures1() const { return versionMajor <= Creatures1Version && isDDE(); }
 	bool isCreatures2() const { return versionMajor > Creatures1Version && isDDE(); }
+
+private:
+// error starts "Error:", so Caos::IsErrorReply knows it for one.
+	static Response Rejected(std::string error);
+// checks, minifies and encodes text; false (with rejected filled in) if it shouldn't be sent.
+	bool Prepare(Script & out, std::string_view text, Response & rejected);
+
+	std::atomic<uint64_t> _scriptsSent{};
+	std::atomic<uint64_t> _scriptBytes{};
+	std::atomic<uint64_t> _bytesSaved{};
+};
+
+// a script ready for the engine: cp1252 text, and the offset just past every endm
+// (outside of strings) so it can be cut into chunks without being looked at again.
+struct SharedMemoryInterface::Script
+{
+	std::string text;
+	std::vector<uint32_t> endm;
 };
 
 struct SharedMemoryInterface::Response
@@ -59,4 +108,8 @@ struct SharedMemoryInterface::Response
 	std::string text{};
 	bool isError{};
 	bool isBinary{};
+// text is plain ascii (so valid utf8 as it is), set on replies from the engine.
+	bool isAscii{};
+// text is already utf8, the backend converted it as it came in.
+	bool isUtf8{};
 };
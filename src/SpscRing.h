@@ -0,0 +1,65 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+// a fixed size queue between exactly one producer thread and one consumer thread, no locks.
+// - each side only writes its own index, the other side reads it to see how far it can go.
+// - the indices only ever count up, slot is index % N, so full and empty can't be confused.
+// - push/pop never block; wait() and waitForRoom() sleep on the other side's index when there's
+//   nothing to do instead of spinning.
+template<typename T, size_t N>
+class SpscRing
+{
+	static_assert(N > 0 && (N & (N - 1)) == 0, "size must be a power of 2");
+
+public:
+// producer only; false if full, item is left alone.
+	bool push(T && item)
+	{
+		auto tail = _tail.load(std::memory_order_relaxed);
+
+		if(tail - _head.load(std::memory_order_acquire) == N)
+			return false;
+
+		_items[tail & (N - 1)] = std::move(item);
+		_tail.store(tail + 1, std::memory_order_release);
+		_tail.notify_one();
+		return true;
+	}
+
+// consumer only; false if empty.
+	bool pop(T & item)
+	{
+		auto head = _head.load(std::memory_order_relaxed);
+
+		if(head == _tail.load(std::memory_order_acquire))
+			return false;
+
+		item = std::move(_items[head & (N - 1)]);
+		_head.store(head + 1, std::memory_order_release);
+		_head.notify_one();
+		return true;
+	}
+
+// consumer only, until there's something to pop.
+	void wait()
+	{
+		auto head = _head.load(std::memory_order_relaxed);
+		_tail.wait(head, std::memory_order_acquire);
+	}
+
+// producer only, until there's room to push.
+	void waitForRoom()
+	{
+		auto tail = _tail.load(std::memory_order_relaxed);
+		_head.wait(tail - N, std::memory_order_acquire);
+	}
+
+private:
+// apart so the two threads aren't fighting over one cache line.
+	alignas(64) std::atomic<size_t> _head{};
+	alignas(64) std::atomic<size_t> _tail{};
+	std::array<T, N> _items{};
+};
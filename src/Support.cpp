@@ -1,6 +1,16 @@
 #include "Support.h"
+#include <cstring>
 #include <vector>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#define SUPPORT_SSE2 1
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 
 int isWhitespace(int c)
 {
@@ -47,44 +57,131 @@ std::string_view TrimWhitespace(std::string_view const& it)
 }
 
 
-std::vector<std::string_view> ChunkMessage(std::string_view message, size_t limit)
+// index of the first of a, b or c at or after i, length if there isn't one.
+static size_t SkipTo(const char * in, size_t i, size_t length, char a, char b, char c)
 {
-	std::vector<std::string_view> chunks;
+#ifdef SUPPORT_SSE2
+	const __m128i va = _mm_set1_epi8(a);
+	const __m128i vb = _mm_set1_epi8(b);
+	const __m128i vc = _mm_set1_epi8(c);
 
-	size_t start = 0;
-	size_t curr = 0;
+	for(; i + 16 <= length; i += 16)
+	{
+		__m128i block = _mm_loadu_si128((__m128i const*)(in + i));
+		uint32_t mask = uint32_t(_mm_movemask_epi8(_mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(block, va), _mm_cmpeq_epi8(block, vb)),
+			_mm_cmpeq_epi8(block, vc))));
+
+		if(mask)
+		{
+#ifdef _MSC_VER
+			unsigned long index;
+			_BitScanForward(&index, mask);
+			return i + index;
+#else
+			return i + __builtin_ctz(mask);
+#endif
+		}
+	}
+#endif
+
+	for(; i < length; ++i)
+	{
+		if(in[i] == a || in[i] == b || in[i] == c)
+			break;
+	}
+
+	return i;
+}
+
+// same rules as encodeScript: words are split by whitespace, a string ends the word it touches.
+std::vector<uint32_t> FindEndm(std::string_view script, bool c1)
+{
+	std::vector<uint32_t> endm;
 
-	while(true)
+	const char * in = script.data();
+	size_t length = script.size();
+	auto isSpace = [](char c) { return (unsigned char)c < 0x80 && isWhitespace(c); };
+
+	char stringDelimiter = c1 ? '[' : '"';
+	char stringEndDelimiter = c1 ? ']' : '"';
+	char escape = c1 ? ']' : '\\';
+
+	for(size_t i = 0; i < length; )
 	{
-		curr = message.find("endm", start);
+		i = SkipTo(in, i, length, stringDelimiter, 'e', 'E');
+
+		if(i == length)
+			break;
 
-		if(curr == std::string_view::npos)
+		if(in[i] == stringDelimiter)
 		{
-			if(start <= message.size()-5)
+			for(++i; i < length; )
 			{
-				chunks.push_back({ message.data() + start, (message.data() + message.size())});
+				i = SkipTo(in, i, length, stringEndDelimiter, escape, escape);
+
+				if(i == length)
+					break;
+
+				if(in[i++] == stringEndDelimiter)
+					break;
+
+			// skip whatever was escaped.
+				++i;
 			}
 
-			break;
+			continue;
+		}
+
+		if((i == 0 || isSpace(in[i-1]))
+		&& i + 4 <= length
+		&& (in[i+1] | 0x20) == 'n' && (in[i+2] | 0x20) == 'd' && (in[i+3] | 0x20) == 'm'
+		&& (i + 4 == length || isSpace(in[i+4])))
+		{
+			endm.push_back(uint32_t(i + 4));
+			i += 4;
+			continue;
 		}
 
-		chunks.push_back({ message.data() + start, (message.data() + curr+4)});
-		start = curr+4;
+		++i;
 	}
 
-	for (auto i = 0u; i < chunks.size(); ++i)
+	return endm;
+}
+
+std::vector<std::string_view> ChunkMessage(std::string_view message, size_t limit)
+{
+	auto endm = FindEndm(message);
+	return ChunkMessage(message, endm, limit);
+}
+
+// packs as many whole scripts into each chunk as will fit, in one pass.
+std::vector<std::string_view> ChunkMessage(std::string_view message, std::span<const uint32_t> endm, size_t limit)
+{
+	std::vector<std::string_view> chunks;
+
+	size_t start = 0;
+	size_t last = 0;
+
+	auto cut = [&](size_t end)
 	{
-		while (i + 1 < chunks.size())
+		if(end - start >= limit && last > start)
 		{
-			size_t combinedSize = chunks[i+1].end() - chunks[i].begin();
-
-			if (combinedSize < limit)
-			{
-				chunks[i] = std::string_view(chunks[i].data(), chunks[i+1].data() + chunks[i+1].size());
-				chunks.erase(chunks.begin()+ (i+1));
-			}
+			chunks.push_back(message.substr(start, last - start));
+			start = last;
 		}
-	}
+
+		last = end;
+	};
+
+	for(auto end : endm)
+		cut(end);
+
+	cut(message.size());
+
+// whitespace after the last endm isn't worth a connection of its own.
+	if(start < message.size() && (chunks.empty() || TrimWhitespace(message.substr(start)).size()))
+		chunks.push_back(message.substr(start));
 
 	return chunks;
 }
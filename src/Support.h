@@ -1,10 +1,18 @@
 #pragma once
+#include <cstdint>
+#include <span>
 #include <string_view>
 #include <vector>
 
 int isWhitespace(int c);
 std::string_view TrimWhitespace(std::string_view const& it);
+// the offset just past every endm in a script, leaving out ones inside strings or longer words.
+// c1 strings are [] and can't escape anything, like encodeScript.
+std::vector<uint32_t> FindEndm(std::string_view script, bool c1 = false);
+// cuts a script at endm into pieces shorter than limit (unless one script on its own is longer).
 std::vector<std::string_view> ChunkMessage(std::string_view message, size_t limit);
+// same, but the endm offsets are already known.
+std::vector<std::string_view> ChunkMessage(std::string_view message, std::span<const uint32_t> endm, size_t limit);
 
 #ifdef _WIN32
 #include <string>
@@ -1,10 +1,15 @@
 #include "WebsocketServer.h"
 #include "Support.h"
 #include "localserver.h"
+#include "RequestScheduler.h"
+#include "Install.h"
+#include "Cp1252.h"
 #include <ixwebsocket/IXNetSystem.h>
 #include <ixwebsocket/IXWebSocket.h>
 #include <ixwebsocket/IXWebSocketServer.h>
 #include <ixwebsocket/IXUserAgent.h>
+#include <ixwebsocket/IXUtf8Validator.h>
+#include <algorithm>
 #include <functional>
 #include <cassert>
 #include <cstdio>
@@ -51,72 +56,58 @@ WebsocketServer::WebsocketServer()
 
 WebsocketServer::~WebsocketServer()
 {
+	_protocols.clear();
 	_clients.clear();
 
 	if (m_server)
 		m_server->stop();
 }
 
-void WebsocketServer::OnGameOpened(SharedMemoryInterface* _interface)
+void WebsocketServer::OnGameOpened(std::shared_ptr<EngineRegistry::Engine> const& engine)
 {
-	m_localServer->OnGameOpened(_interface);
+	auto _interface = engine->interface.get();
 
 	std::lock_guard lock(_mutex);
-	assert(this->_interface == nullptr);
-	this->_interface = _interface;
+	assert(std::find(_engines.begin(), _engines.end(), engine) == _engines.end());
+	_engines.push_back(engine);
 
-	char buffer[256];
-	snprintf(buffer, sizeof(buffer), "%s %s %d.%d %s", "OnGameOpened", _interface->_engine.c_str(), _interface->versionMajor, _interface->versionMinor, _interface->_name.c_str());
-	std::string message = buffer;
+	auto message = engine->Describe("OnGameOpened");
 
-	fprintf(stderr, "%s\n", buffer);
+	fprintf(stderr, "%s\n", message.c_str());
 
 	if(_interface->_workingDirectory.empty() == false)
 	{
 		fprintf(stderr, "%s\n", _interface->_workingDirectory.string().c_str());
 	}
 
-	for (auto& item : _allConnections)
-	{
-		auto agent = item.lock();
-
-		if (agent)
-		{
-			agent->sendUtf8Text(message);
-		}
-	}
+	Broadcast(message);
 }
 
 
-void WebsocketServer::OnGameClosed(SharedMemoryInterface* _interface)
+void WebsocketServer::OnGameClosed(std::shared_ptr<EngineRegistry::Engine> const& engine)
 {
-	m_localServer->OnGameClosed(_interface);
-
+// let go of them only once the lock is gone: closing a socket raises its Close message, which takes the lock.
+	std::vector<ClientConnection> closing;
 	std::lock_guard lock(_mutex);
-	assert(this->_interface == _interface);
-	this->_interface = nullptr;
+	assert(std::find(_engines.begin(), _engines.end(), engine) != _engines.end());
+	std::erase(_engines, engine);
 
-	char buffer[256];
-	snprintf(buffer, sizeof(buffer), "%s %s %d.%d %s", "OnGameClosed", _interface->_engine.c_str(), _interface->versionMajor, _interface->versionMinor, _interface->_name.c_str());
-	std::string message = buffer;
+// its scheduler is about to go, and the installs with it.
+	std::erase_if(_installs, [&engine](auto const& item) { return item.second.engine.lock() == engine; });
 
-	fprintf(stderr, "%s\n", buffer);
+	auto message = engine->Describe("OnGameClosed");
 
-	for (auto & item : _allConnections)
-	{
-		auto agent = item.lock();
-
-		if (agent)
-		{
-			agent->sendUtf8Text(message);
-		}
-	}
+	fprintf(stderr, "%s\n", message.c_str());
 
+	Broadcast(message);
 
 	for(auto i = 0u; i < _clients.size(); ++i)
 	{
-		if(_clients[i].isGameConnection)
+		if(_clients[i].isGameConnection && _clients[i].engine == engine.get())
 		{
+			_selectors.erase(_clients[i].socket.get());
+			_protocols.remove(_clients[i].socket.get());
+			closing.push_back(std::move(_clients[i]));
 			_clients.erase(_clients.begin()+i);
 			--i;
 		}
@@ -128,30 +119,21 @@ void WebsocketServer::CloseUnaffiliatedClients()
 	if(portClosed.exchange(false) == false)
 		return;
 
+// as in OnGameClosed, these are destroyed after the lock is released.
+	std::vector<ClientConnection> closing;
 	std::lock_guard lock(_mutex);
 
 	for(auto i = 0u; i < _clients.size(); ++i)
 	{
 		if(_clients[i].parent.use_count() == 0)
 		{
+			_protocols.remove(_clients[i].socket.get());
+			closing.push_back(std::move(_clients[i]));
 			_clients.erase(_clients.begin()+i);
 			--i;
 		}
 	}
 
-	for (auto ptr = socketsByProtocol.begin(); ptr != socketsByProtocol.end(); )
-	{
-		auto next = ptr; ++next;
-		auto agent = ptr->second.lock();
-
-		if(ptr->second.use_count() == 0)
-		{
-			socketsByProtocol.erase(ptr);
-		}
-
-		ptr = next;
-	}
-
 	for (auto i = 0u; i < _allConnections.size(); ++i)
 	{
 		if (_allConnections[i].use_count() == 0)
@@ -189,8 +171,71 @@ void WebsocketServer::OnConnection(std::weak_ptr<ix::WebSocket> webSocket, std::
 	std::lock_guard lock(_mutex);
 	for (auto& item : agent->getSubProtocols())
 	{
-		socketsByProtocol.insert({ item, webSocket });
+// engine:<id or name> picks which game this client talks to.
+		if (item.starts_with("engine:"))
+			_selectors[agent.get()] = item.substr(7);
+		else
+			_protocols.add(_protocols.intern(item), agent);
+	}
+}
+
+std::shared_ptr<EngineRegistry::Engine> WebsocketServer::GetEngine(ix::WebSocket const* client)
+{
+	auto itr = _selectors.find(client);
+
+	if (itr == _selectors.end())
+		return _engines.size()? _engines.back() : nullptr;
+
+	for (auto & engine : _engines)
+	{
+		if (engine->Matches(itr->second))
+			return engine;
 	}
+
+	return nullptr;
+}
+
+SharedMemoryInterface::Response WebsocketServer::SelectEngine(ix::WebSocket const* client, std::string_view selector)
+{
+	std::lock_guard lock(_mutex);
+
+// no selector, list what's running.
+	if (selector.empty())
+	{
+		std::string text;
+
+		for (auto & engine : _engines)
+		{
+			text += engine->Describe();
+			text += "\n";
+		}
+
+		return SharedMemoryInterface::Response{
+			.text = text.size()? text : "Game is not open!",
+			.isError = text.empty(),
+			.isBinary = false,
+		};
+	}
+
+	for (auto & engine : _engines)
+	{
+		if (engine->Matches(selector))
+		{
+			_selectors[client] = std::string(selector);
+
+			return SharedMemoryInterface::Response{
+				.text = engine->Describe(),
+				.isError = false,
+				.isBinary = false,
+			};
+		}
+	}
+
+	return SharedMemoryInterface::Response{
+		.text = "No engine matches: " + std::string(selector),
+		.isError = true,
+		.isBinary = false,
+	};
 }
 
 void WebsocketServer::OnMessageCallback(std::weak_ptr<ix::WebSocket> webSocket, const ix::WebSocketMessagePtr& msg)
@@ -203,12 +248,8 @@ void WebsocketServer::OnMessageCallback(std::weak_ptr<ix::WebSocket> webSocket,
 		std::lock_guard lock(_mutex);
 		_allConnections.push_back(webSocket);
 
-		if (_interface)
-		{
-			char buffer[256];
-			snprintf(buffer, sizeof(buffer), "%s %s %d.%d %s", "OnGameOpened", _interface->_engine.c_str(), _interface->versionMajor, _interface->versionMinor, _interface->_name.c_str());
-			agent->sendUtf8Text(buffer);
-		}
+		for (auto & engine : _engines)
+			agent->sendUtf8Text(engine->Describe("OnGameOpened"));
 
 		return;
 	}
@@ -219,6 +260,39 @@ void WebsocketServer::OnMessageCallback(std::weak_ptr<ix::WebSocket> webSocket,
 
 	if (msg->type == ix::WebSocketMessageType::Close)
 	{
+	// cancelled once the lock is released, like the sockets in OnGameClosed.
+		std::vector<Installing> cancelling;
+
+		{
+		// ours outlives the lock, so letting go of the table's doesn't close it while we hold it.
+			auto agent = webSocket.lock();
+			std::lock_guard lock(_mutex);
+
+		// it may have switched engines along the way.
+			for (auto & engine : _engines)
+			{
+				if (agent)
+					engine->scheduler->drop(agent.get());
+			}
+
+			auto range = _installs.equal_range(agent.get());
+
+			for (auto it = range.first; it != range.second; ++it)
+				cancelling.push_back(std::move(it->second));
+
+			_installs.erase(range.first, range.second);
+			_selectors.erase(agent.get());
+
+		// the ones we opened ourselves reconnect, they stay until we let go of them.
+			bool ours = std::any_of(_clients.begin(), _clients.end(), [&agent](auto const& client) { return client.socket == agent; });
+
+			if (agent && ours == false)
+				_protocols.remove(agent.get());
+		}
+
+		for (auto & installing : cancelling)
+			Cancel(installing);
+
 		portClosed = true;
 		fprintf(stderr, "WebSocketClosed (%d): %s", msg->closeInfo.code, msg->closeInfo.reason.data());
 		return;
@@ -227,6 +301,16 @@ void WebsocketServer::OnMessageCallback(std::weak_ptr<ix::WebSocket> webSocket,
 	if (msg->type == ix::WebSocketMessageType::Error)
 	{
 		fprintf(stderr, "WebSocketError (%d): %s", msg->errorInfo.retries, msg->errorInfo.reason.data());
+
+	// one that fails its handshake never sends Close, don't keep routing to it.
+	// the ones we opened ourselves retry, as with Close they stay.
+		auto agent = webSocket.lock();
+		std::lock_guard lock(_mutex);
+		bool ours = std::any_of(_clients.begin(), _clients.end(), [&agent](auto const& client) { return client.socket == agent; });
+
+		if (agent && ours == false)
+			_protocols.remove(agent.get());
+
 		return;
 	}
 
@@ -265,19 +349,64 @@ void WebsocketServer::OnMessageCallback(std::weak_ptr<ix::WebSocket> webSocket,
 
 				if(code == LocalServer::OOPE)
 				{
-					Parse(c_str, agent);
+					Parse(DebugLine::Parse(c_str), agent);
+				}
+				else if(code == LocalServer::ENGN)
+				{
+					result = SelectEngine(agent.get(), c_str);
+				}
+				else if(code == LocalServer::INST)
+				{
+					result = StartInstall(webSocket, TrimWhitespace(c_str), binaryBuffer);
+				}
+				else if(code == LocalServer::STOP)
+				{
+					result = CancelInstall(agent.get(), TrimWhitespace(c_str));
 				}
 				else
 				{
-					result = m_localServer->ProcessMessage(code, c_str, binaryBuffer);
+					std::shared_ptr<EngineRegistry::Engine> engine;
+
+					{
+						std::lock_guard lock(_mutex);
+						engine = GetEngine(agent.get());
+					}
+
+					result = m_localServer->ProcessMessage(code, c_str, binaryBuffer, engine.get());
 				}
 			}
 		}
 		else
 		{
+			std::shared_ptr<EngineRegistry::Engine> engine;
+
+			{
+				std::lock_guard lock(_mutex);
+				engine = GetEngine(webSocket.lock().get());
+
+			// whatever this makes the game write to its debug log should get back quickly.
+				if(engine)
+					engine->Nudge();
+			}
+
 			try
 			{
-				result = _interface->send(msg->str);
+				if (engine == nullptr)
+				{
+					result = SharedMemoryInterface::Response{
+						.text = "Game is not open!",
+						.isError = true,
+						.isBinary = false,
+					};
+				}
+				else
+				{
+				// answered from the engine's thread so a slow script doesn't hold up this one.
+					engine->scheduler->submit(webSocket.lock().get(), RequestScheduler::Classify(msg->str), msg->str, [webSocket](SharedMemoryInterface::Response result)
+					{
+						SendResponse(webSocket, result);
+					});
+				}
 			}
 			catch (std::exception& e)
 			{
@@ -287,119 +416,158 @@ void WebsocketServer::OnMessageCallback(std::weak_ptr<ix::WebSocket> webSocket,
 			}
 		}
 
-		if(result.text.size())
+		SendResponse(webSocket, result);
+	}
+}
+
+SharedMemoryInterface::Response WebsocketServer::StartInstall(std::weak_ptr<ix::WebSocket> const& webSocket, std::string_view id, std::string_view script)
+{
+	auto client = webSocket.lock().get();
+	std::shared_ptr<EngineRegistry::Engine> engine;
+	std::string name(id);
+
+	{
+		std::lock_guard lock(_mutex);
+		engine = GetEngine(client);
+
+		if (name.empty())
+			name = std::to_string(++_nextInstall);
+
+	// forget the ones that have finished while we're here.
+		std::erase_if(_installs, [](auto const& item) { return item.second.install.expired(); });
+	}
+
+	if (engine == nullptr)
+	{
+		return SharedMemoryInterface::Response{
+			.text = "Game is not open!",
+			.isError = true,
+			.isBinary = false,
+		};
+	}
+
+	if (script.empty())
+	{
+		return SharedMemoryInterface::Response{
+			.text = "INST needs the script in the binary buffer.",
+			.isError = true,
+			.isBinary = false,
+		};
+	}
+
+	auto install = Install::Start(name, std::string(script), engine->interface->isDDE(), engine->scheduler.get(), [webSocket](std::string const& message)
+	{
+		if (auto agent = webSocket.lock())
+			agent->sendUtf8Text(message);
+	});
+
+// only somewhere to cancel it from if the game didn't close while it started.
+	std::lock_guard lock(_mutex);
+
+	if (std::find(_engines.begin(), _engines.end(), engine) != _engines.end())
+		_installs.insert({client, Installing{ .engine = engine, .install = install }});
+
+	return {};
+}
+
+SharedMemoryInterface::Response WebsocketServer::CancelInstall(ix::WebSocket const* client, std::string_view id)
+{
+	std::unique_lock lock(_mutex);
+
+	auto range = _installs.equal_range(client);
+
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		auto install = it->second.install.lock();
+
+		if (install && (id.empty() || install->id() == id))
 		{
-			auto agent = webSocket.lock();
+			auto installing = std::move(it->second);
+			_installs.erase(it);
+			lock.unlock();
 
-			if(result.isError)
-				agent->close(ix::WebSocketCloseConstants::kProtocolErrorCode, result.text);
-			else if(result.isBinary)
-				agent->sendBinary(result.text);
-			else
-				agent->sendUtf8Text(result.text);
+			Cancel(installing);
+			return {};
 		}
 	}
+
+	return SharedMemoryInterface::Response{
+		.text = "No install running called: " + std::string(id),
+		.isError = true,
+		.isBinary = false,
+	};
 }
 
-struct WebsocketServer::ParseResult
+void WebsocketServer::Cancel(Installing const& installing)
 {
-	std::string url;
-	int port;
-	std::string message;
-	std::string protocol;
-	bool noMatch;
-};
-
-// this function looks for this stuff:
-// ws://url:port[protocol]
-// wss://url:port[protocol]
-// ws://url:port[protocol]:message
-// wss://url:port[protocol]:message
-// ws[protocol]:message
-WebsocketServer::ParseResult WebsocketServer::GetParseResult(std::string_view str)
+// holding the engine keeps its scheduler around for the cancel; if it's already gone so is
+// everything the install had queued, it was told the game closed.
+	auto engine = installing.engine.lock();
+	auto install = installing.install.lock();
+
+	if (engine && install)
+		install->cancel();
+}
+
+void WebsocketServer::SendResponse(std::weak_ptr<ix::WebSocket> const& webSocket, SharedMemoryInterface::Response const& result)
 {
-	ParseResult result;
-	result.noMatch = true;
-
-	// Helper lambda to find and extract a substring between two delimiters
-	auto extract = [&str](char start, char end) -> std::string_view {
-		auto startPos = str.find(start);
-		if (startPos == std::string_view::npos) return {};
-		auto endPos = str.find(end, startPos + 1);
-		if (endPos == std::string_view::npos) return {};
-		return str.substr(startPos + 1, endPos - startPos - 1);
-	};
+	if(result.text.empty())
+		return;
 
-	// Check for ws:// or wss:// prefix
-	if (str.starts_with("ws://") || str.starts_with("wss://")) {
-		result.protocol = str.substr(0, str.find("://"));
-		str.remove_prefix(result.protocol.length() + 3);  // Remove protocol and ://
-
-		// Extract URL and port
-		auto colonPos = str.find(':');
-		if (colonPos != std::string_view::npos) {
-			result.url = str.substr(0, colonPos);
-			str.remove_prefix(colonPos + 1);
-
-			// Extract port
-			auto portEnd = str.find_first_not_of("0123456789");
-			if (portEnd != std::string_view::npos) {
-				result.port = std::stoi(std::string(str.substr(0, portEnd)));
-				str.remove_prefix(portEnd);
-			}
-		}
+	auto agent = webSocket.lock();
 
-		// Extract protocol (if present)
-		result.protocol = extract('[', ']');
+	if(!agent)
+		return;
 
-		// Extract message (if present)
-		if (!str.empty() && str.front() == ':') {
-			str.remove_prefix(1);
-			result.message = str;
-		}
+	if(result.isError)
+		agent->close(ix::WebSocketCloseConstants::kProtocolErrorCode, result.text);
+	else if(result.isBinary)
+		agent->sendBinary(result.text);
+// ascii is already known to be valid utf8, don't have it checked again.
+	else if(result.isAscii)
+		agent->send(result.text);
+	else
+		agent->sendUtf8Text(result.text);
+}
 
-		result.noMatch = false;
-	}
-	// Check for ws[protocol]:message format
-	else if (str.starts_with("ws")) {
-		result.protocol = "ws";
-		result.protocol = extract('[', ']');
-
-		if (!str.empty() && str.front() == ':') {
-			str.remove_prefix(1);
-			result.message = str;
-		}
+bool WebsocketServer::IsValidText(std::string const& text)
+{
+	return FindNonAscii(text.data(), text.size()) == text.size() || ix::validateUtf8(text);
+}
 
-		result.noMatch = false;
+void WebsocketServer::Broadcast(std::string const& message)
+{
+	if(IsValidText(message) == false)
+	{
+		fprintf(stderr, "Not sent, not valid utf8: %s\n", message.c_str());
+		return;
 	}
 
-	return result;
+	for (auto & item : _allConnections)
+	{
+		if (auto agent = item.lock())
+			agent->send(message);
+	}
 }
 
-bool WebsocketServer::Parse(std::string_view str, std::shared_ptr<ix::WebSocket> parent)
+bool WebsocketServer::Parse(DebugLine const& parse, std::shared_ptr<ix::WebSocket> parent, EngineRegistry::Engine* engine)
 {
-	auto parse = GetParseResult(str);
-
-	if(parse.noMatch || parse.protocol.empty())
+	if(parse.kind == DebugLine::Kind::Log)
 		return false;
 
 	std::lock_guard lock(_mutex);
 
 // rebuild it just so we're extra sure that it's right.
-	std::string _url = ((std::string("wss://") += parse.url) += ":") += std::to_string(port);
+	std::string _url = ((std::string("wss://") += parse.host) += ":") += std::to_string(port);
 
-	if(parse.url.size())
+	if(parse.host.size())
 	{
-		auto range = socketsByProtocol.equal_range(parse.protocol);
-
-
+		auto protocol = _protocols.intern(parse.protocol);
 		std::shared_ptr<ix::WebSocket> match;
 
-		for (auto it = range.first; it != range.second; ++it)
+		for (auto & agent : _protocols.members(protocol))
 		{
-			auto agent = it->second.lock();
-
-			if(agent && agent->getUrl() == _url)
+			if(agent->getUrl() == _url)
 			{
 				match = agent;
 				break;
@@ -410,47 +578,41 @@ bool WebsocketServer::Parse(std::string_view str, std::shared_ptr<ix::WebSocket>
 		{
 			match = std::make_shared<ix::WebSocket>();
 			match->setOnMessageCallback(std::bind(&WebsocketServer::OnMessageCallback, this, std::weak_ptr(match), std::placeholders::_1));
-			match->addSubProtocol(parse.protocol);
+			match->addSubProtocol(std::string(parse.protocol));
 			match->setUrl(_url);
 			match->start();
 
 			_clients.push_back({
 				.socket = match,
 				.parent = std::weak_ptr(parent),
+				.engine = engine,
 				.isGameConnection = (parent == nullptr)
 			});
 
-			socketsByProtocol.insert({parse.protocol, std::weak_ptr(match)});
-		}
-		else
-		{
-			for(auto & p : match->getSubProtocols())
-			{
-				if(p == parse.protocol)
-					goto have_protocol;
-			}
-
-			match->addSubProtocol(parse.protocol);
-			socketsByProtocol.insert({parse.protocol, std::weak_ptr(match)});
+			if(engine)
+				_selectors[match.get()] = std::to_string(engine->id);
 
-		have_protocol:
-			(void)0;
+			_protocols.add(protocol, match);
 		}
 	}
 
-	if(parse.message.size())
+	auto protocol = _protocols.find(parse.protocol);
+
+	if(parse.message.size() && protocol != ProtocolTable::npos)
 	{
-		auto range = socketsByProtocol.equal_range(parse.protocol);
+	// made and checked once, then the same string goes to everyone.
+		std::string message(parse.message);
 
-		for (auto it = range.first; it != range.second; ++it)
+		if(IsValidText(message) == false)
 		{
-			auto agent = it->second.lock();
+			fprintf(stderr, "Not sent, not valid utf8: %s\n", message.c_str());
+			return true;
+		}
 
-			if(agent)
-			{
-				if(parse.url.empty() || _url == agent->getUrl())
-					agent->sendUtf8Text(parse.message);
-			}
+		for (auto & agent : _protocols.members(protocol))
+		{
+			if(parse.host.empty() || _url == agent->getUrl())
+				agent->send(message);
 		}
 	}
 
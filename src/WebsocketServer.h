@@ -1,5 +1,8 @@
 #pragma once
 #include "SharedMemoryInterface.h"
+#include "EngineRegistry.h"
+#include "DebugLine.h"
+#include "ProtocolTable.h"
 #include <string_view>
 #include <map>
 #include <vector>
@@ -15,6 +18,7 @@ namespace ix {
 }
 
 class LocalServer;
+class Install;
 
 class WebsocketServer
 {
@@ -45,30 +49,56 @@ public:
 		int ipv6[6];
 	};
 
-	void OnGameOpened(SharedMemoryInterface*);
-	void OnGameClosed(SharedMemoryInterface*);
+	void OnGameOpened(std::shared_ptr<EngineRegistry::Engine> const&);
+	void OnGameClosed(std::shared_ptr<EngineRegistry::Engine> const&);
 	void CloseUnaffiliatedClients();
 
-	bool Parse(std::string_view,  std::shared_ptr<ix::WebSocket> parent = nullptr);
+// engine is the game the line came from, if any; replies on sockets it opens go back to it.
+// false if the line is just log.
+	bool Parse(DebugLine const& line, std::shared_ptr<ix::WebSocket> parent = nullptr, EngineRegistry::Engine* engine = nullptr);
 
 private:
 	void OnConnection(std::weak_ptr<ix::WebSocket> webSocket, std::shared_ptr<ix::ConnectionState> connectionState);
 	void OnMessageCallback(std::weak_ptr<ix::WebSocket> webSocket, const ix::WebSocketMessagePtr& msg);
-
-struct ParseResult;
-	ParseResult GetParseResult(std::string_view str);
+	static void SendResponse(std::weak_ptr<ix::WebSocket> const& webSocket, SharedMemoryInterface::Response const& result);
+// text frames must be utf8; ix checks on every send, this is for checking once before sending to many.
+	static bool IsValidText(std::string const& text);
+// the same message to every client; _mutex must be held.
+	void Broadcast(std::string const& message);
+
+// the engine this client picked, or the newest one if it didn't; _mutex must be held.
+// keep hold of it to use it after the lock is gone, the game can close in the meantime.
+	std::shared_ptr<EngineRegistry::Engine> GetEngine(ix::WebSocket const* client);
+	SharedMemoryInterface::Response SelectEngine(ix::WebSocket const* client, std::string_view selector);
+	SharedMemoryInterface::Response StartInstall(std::weak_ptr<ix::WebSocket> const& webSocket, std::string_view id, std::string_view script);
+	SharedMemoryInterface::Response CancelInstall(ix::WebSocket const* client, std::string_view id);
 
 	std::mutex _mutex;
-	SharedMemoryInterface* _interface{};
+	std::vector<std::shared_ptr<EngineRegistry::Engine>> _engines;
+	std::map<ix::WebSocket const*, std::string> _selectors;
+
+	struct Installing
+	{
+		std::weak_ptr<EngineRegistry::Engine> engine;
+		std::weak_ptr<Install> install;
+	};
+
+// _mutex must not be held, dropping its chunks can reach the engine.
+	static void Cancel(Installing const& installing);
+
+// by client; they keep themselves alive while they run, these are only to cancel them.
+	std::multimap<ix::WebSocket const*, Installing> _installs;
+	int _nextInstall{};
 	std::unique_ptr<LocalServer>			m_localServer;
 	std::unique_ptr<ix::WebSocketServer>	m_server;
 	std::unique_ptr<ix::SocketTLSOptions>	m_tls;
-	std::multimap<std::string, std::weak_ptr<ix::WebSocket>> socketsByProtocol;
+	ProtocolTable _protocols;
 
 	struct ClientConnection
 	{
 		std::shared_ptr<ix::WebSocket> socket;
 		std::weak_ptr<ix::WebSocket> parent;
+		EngineRegistry::Engine* engine{};
 		bool isGameConnection{};
 	};
 
@@ -10,6 +10,7 @@ VivariumInterface::VivariumInterface(int major, int minor)
 {
 	_name = "Creatures";
 	_engine = "Vivarium";
+	_address = "DDE";
 	versionMinor = minor;
 	versionMajor = major;
 
@@ -59,8 +60,11 @@ std::unique_ptr<SharedMemoryInterface> VivariumInterface::OpenVivarium()
 	}
 }
 
-VivariumInterface::Response VivariumInterface::send1252(std::string & message)
+VivariumInterface::Response VivariumInterface::send1252(std::string_view text)
 {
+// DDE wants a null terminated copy anyway.
+	std::string message(text);
+
 	try
 	{
 		auto session = CreaturesSession::GetSession();
@@ -17,7 +17,7 @@ public:
 	VivariumInterface(int major, int minor);
 	~VivariumInterface();
 
-	Response send1252(std::string &) override;
+	Response send1252(std::string_view) override;
 	bool isClosed() override;
 
 private:
@@ -102,13 +102,14 @@ std::unique_ptr<SharedMemoryInterface> WindowsSMI::Open(const char* name)
 
 	// Open a handle to the creator process
 	r->creator_process_handle = OpenProcess(PROCESS_QUERY_INFORMATION, FALSE, r->memory_ptr->pid);
+	r->_address = name;
 	r->Initialize();
 
 	return std::unique_ptr<SharedMemoryInterface>(r.release());
 }
 
 
-WindowsSMI::Response WindowsSMI::send1252(std::string & text)
+WindowsSMI::Response WindowsSMI::send1252(std::string_view text)
 {
 	if (text.empty())
 	{
@@ -150,7 +151,7 @@ WindowsSMI::Response WindowsSMI::send1252(std::string & text)
 	}
 
 	uint32_t headerSize = 0;
-	bool isScript = strncmp(text.data(), "srcp", 4) == 0;
+	bool isScript = text.starts_with("srcp");
 	auto size_limit = memory_ptr->memBufferSize - sizeof(Message) - sizeof("execute\n");
 
 	auto chunks = ChunkMessage(text, memory_ptr->memBufferSize - sizeof(Message) - sizeof("execute\n"));
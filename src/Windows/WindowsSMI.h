@@ -15,7 +15,7 @@ struct Message;
 	WindowsSMI();
 	~WindowsSMI();
 
-	Response send1252(std::string &) override;
+	Response send1252(std::string_view) override;
 	bool isClosed() override;
 
 private:
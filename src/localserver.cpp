@@ -1,8 +1,10 @@
 #include "localserver.h"
 #include "DebugLog.h"
+#include "RequestScheduler.h"
 #include <vector>
 #include <fstream>
 #include <cstring>
+#include <cstdlib>
 #include <system_error>
 
 #include "qrcodegen.h"
@@ -21,19 +23,6 @@ LocalServer::~LocalServer()
 	Save();
 }
 
-void  LocalServer::OnGameOpened(SharedMemoryInterface* i)
-{
-	std::lock_guard lock(_mutex);
-	_interface = i;
-}
-
-void  LocalServer::OnGameClosed(SharedMemoryInterface* i)
-{
-	(void)i;
-	std::lock_guard lock(_mutex);
-	_interface = nullptr;
-}
-
 void LocalServer::Load()
 {
 	std::lock_guard lock(_mutex);
@@ -107,10 +96,8 @@ void LocalServer::Save()
 	}
 }
 
-std::filesystem::path LocalServer::GetPath(std::string_view file)
+std::filesystem::path LocalServer::GetPath(std::string_view file, SharedMemoryInterface* _interface)
 {
-	std::lock_guard lock(_mutex);
-
 	if(_interface == nullptr)
 		return {};
 	std::filesystem::path file_name(file);
@@ -244,8 +231,9 @@ std::vector<std::string_view> LocalServer::Parse(std::string_view str)
 }
 
 
-LocalServer::Response LocalServer::ProcessMessage(uint32_t code, std::string_view c_str, std::string_view binary_buffer)
+LocalServer::Response LocalServer::ProcessMessage(uint32_t code, std::string_view c_str, std::string_view binary_buffer, EngineRegistry::Engine* engine)
 {
+	auto _interface = engine? engine->interface.get() : nullptr;
 	auto args =  LocalServer::Parse(c_str);
 	std::filesystem::path src;
 	std::filesystem::path dst;
@@ -270,6 +258,72 @@ LocalServer::Response LocalServer::ProcessMessage(uint32_t code, std::string_vie
 		};
 	} 
 	break;
+	case LocalServer::STAT:
+	{
+		if (_interface)
+		{
+			return Response{
+				.text = _interface->GetStatistics() + _interface->GetScriptStatistics() + engine->scheduler->GetStatistics() + engine->GetStatistics(),
+				.isError = false,
+				.isBinary = false,
+			};
+		}
+
+		return Response{
+			.text = "Game is not open!",
+			.isError = true,
+			.isBinary = false,
+		};
+	}
+	break;
+	case LocalServer::CACH:
+	{
+		if (_interface == nullptr)
+		{
+			return Response{
+				.text = "Game is not open!",
+				.isError = true,
+				.isBinary = false,
+			};
+		}
+
+		auto & cache = engine->scheduler->cache;
+
+		if(args.size())
+		{
+		// milliseconds, or engine ticks with a t on the end.
+			auto arg = args[0];
+			bool ticks = arg.size() && (arg.back() == 't' || arg.back() == 'T');
+
+			if(ticks)
+				arg.remove_suffix(1);
+
+			char * end{};
+			std::string number(arg);
+			long long value = strtoll(number.c_str(), &end, 10);
+
+			if(number.empty() || *end != '\0' || value < 0)
+			{
+				return Response{
+					.text = "Cache time should be a number of milliseconds, or ticks followed by t.",
+					.isError = true,
+					.isBinary = false,
+				};
+			}
+
+			if(ticks)
+				cache.setTtl(value * ResponseCache::GetTickLength(Caos::GetDialect(*_interface)));
+			else
+				cache.setTtl(std::chrono::milliseconds(value));
+		}
+
+		return Response{
+			.text = std::to_string(std::chrono::duration_cast<std::chrono::milliseconds>(cache.getTtl()).count()),
+			.isError = false,
+			.isBinary = false,
+		};
+	}
+	break;
 	case LocalServer::SAVE:
 		if(args.size() < 1)
 		{
@@ -280,7 +334,7 @@ LocalServer::Response LocalServer::ProcessMessage(uint32_t code, std::string_vie
 			};
 		}
 
-		dst = GetPath(args[0]);
+		dst = GetPath(args[0], _interface);
 
 		if(dst.empty())
 		{
@@ -333,7 +387,7 @@ LocalServer::Response LocalServer::ProcessMessage(uint32_t code, std::string_vie
 		}
 
 
-		src = GetPath(c_str);
+		src = GetPath(c_str, _interface);
 
 		if(src.empty())
 		{
@@ -390,7 +444,7 @@ LocalServer::Response LocalServer::ProcessMessage(uint32_t code, std::string_vie
 			};
 		}
 
-		src = GetPath(c_str);
+		src = GetPath(c_str, _interface);
 		if(CanModify(src) && std::filesystem::exists(src))
 		{
 			std::remove(src.string().c_str());
@@ -416,8 +470,8 @@ LocalServer::Response LocalServer::ProcessMessage(uint32_t code, std::string_vie
 			};
 		}
 
-		src = GetPath(args[0]);
-		dst = GetPath(args[1]);
+		src = GetPath(args[0], _interface);
+		dst = GetPath(args[1], _interface);
 
 		if(src.empty())
 		{
@@ -465,7 +519,7 @@ LocalServer::Response LocalServer::ProcessMessage(uint32_t code, std::string_vie
 			};
 		}
 
-		dst = GetPath(args[1]);
+		dst = GetPath(args[1], _interface);
 
 		if(dst.empty())
 		{
@@ -519,6 +573,11 @@ LocalServer::Response LocalServer::ProcessMessage(uint32_t code, std::string_vie
 	case LocalServer::OOPE:
 		DebugLog::WriteDebugMessage(c_str);
 		break;
+// picking an engine and installs are per client, the websocket server answers them.
+	case LocalServer::ENGN:
+	case LocalServer::INST:
+	case LocalServer::STOP:
+		break;
 	}
 
 	return {};
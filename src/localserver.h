@@ -1,6 +1,7 @@
 #ifndef LOCALSERVER_H
 #define LOCALSERVER_H
 #include "SharedMemoryInterface.h"
+#include "EngineRegistry.h"
 #include <filesystem>
 #include <map>
 #include <string_view>
@@ -31,6 +32,11 @@ using Response = SharedMemoryInterface::Response;
 		DBG  = MAKEFOURCC('D', 'B', 'G', '\0'),
 		OOPE = MAKEFOURCC('O', 'O', 'P', 'E'),
 		PATH = MAKEFOURCC('P', 'A', 'T', 'H'),
+		STAT = MAKEFOURCC('S', 'T', 'A', 'T'),
+		ENGN = MAKEFOURCC('E', 'N', 'G', 'N'),
+		INST = MAKEFOURCC('I', 'N', 'S', 'T'),
+		STOP = MAKEFOURCC('S', 'T', 'O', 'P'),
+		CACH = MAKEFOURCC('C', 'A', 'C', 'H'),
 	};
 
 // split into args.
@@ -39,24 +45,20 @@ using Response = SharedMemoryInterface::Response;
 	LocalServer();
 	~LocalServer();
 
-	void OnGameOpened(SharedMemoryInterface*);
-	void OnGameClosed(SharedMemoryInterface*);
-
-
-	Response ProcessMessage(uint32_t code, std::string_view c_str, std::string_view binary_buffer);
+// engine is the game the client is talking to, nullptr if there isn't one.
+	Response ProcessMessage(uint32_t code, std::string_view c_str, std::string_view binary_buffer, EngineRegistry::Engine* engine);
 
 private:
 	void Load();
 	void Save();
 
-	std::filesystem::path GetPath(std::string_view file);
+	std::filesystem::path GetPath(std::string_view file, SharedMemoryInterface* _interface);
 	bool CanModify(std::filesystem::path const& path);
 	void OnModifiedFile(std::filesystem::path const& path, bool exists);
 
 	std::filesystem::path _logFile;
 	std::map<std::filesystem::path, uint64_t> _files;
 	std::mutex _mutex;
-	SharedMemoryInterface * _interface{};
 };
 
 #endif // LOCALSERVER_H
@@ -5,8 +5,11 @@
 #include <ixwebsocket/IXNetSystem.h>
 #include "WebsocketServer.h"
 #include "DebugLog.h"
+#include "EngineWatcher.h"
+#include "EngineRegistry.h"
 #include "Support.h"
 #include <csignal>
+#include <algorithm>
 #include <chrono>
 #include <thread>
 #include <condition_variable>
@@ -17,6 +20,8 @@
 using namespace std::chrono_literals;
 static std::atomic<bool> g_running{true};
 static std::condition_variable _mainSleep;
+// set by the watcher when something happened to the engine's port file.
+static std::atomic<bool> g_engineChanged{false};
 // needed out here by win console handler (annoying)
 
 bool IsRunning()
@@ -84,128 +89,53 @@ int main()
 // test debug log
 
 	std::unique_ptr<WebsocketServer>	   server(new WebsocketServer);
-	std::unique_ptr<SharedMemoryInterface> interface;
-	std::unique_ptr<DebugLog>			  debugLog;
 
-	bool isDebugLogOpen = false;
-	bool isC2E = false;
-
-	while (IsRunning())
+// flag is set under the lock so we can't miss it between checking and going to sleep.
+	auto wake = [&dummy_mutex]()
 	{
-		if (interface == nullptr)
 		{
-			interface = SharedMemoryInterface::Open();
-
-			if (interface == nullptr)
-			{
-				_mainSleep.wait_for(lock, 1s);
-				continue;
-			}
-
-			server->OnGameOpened(interface.get());
-			_mainSleep.wait_for(lock, 50ms);
-			isC2E = !interface->isDDE();
+			std::lock_guard guard(dummy_mutex);
+			g_engineChanged = true;
 		}
 
-		if (interface->isClosed())
-		{
-			server->OnGameClosed(interface.get());
+		_mainSleep.notify_all();
+	};
 
-			debugLog = nullptr;
-			interface = nullptr;
-			isDebugLogOpen = false;
-			_mainSleep.wait_for(lock, 1s);
-			continue;
-		}
+	std::unique_ptr<EngineWatcher>  watcher = EngineWatcher::Open(wake);
+	std::unique_ptr<EngineRegistry> engines(new EngineRegistry(server.get(), wake));
 
-		auto log = DebugLog::GetDebugLog();
-		bool wrote = false;
+	auto nextScan = std::chrono::steady_clock::now();
 
-		if(log.size())
-		{
-			if (isDebugLogOpen)
-				isDebugLogOpen = !debugLog->isClosed();
+	while (IsRunning())
+	{
+// looking for engines isn't free on windows, only do it when told to or once in a while.
+		auto now = std::chrono::steady_clock::now();
+		bool scan = g_engineChanged || now >= nextScan;
+		g_engineChanged = false;
 
-			for(auto & item : log)
-			{
-				fprintf(stdout, "%.*s", int(item.size()), item.data());
-			}
-		}
+		if (scan)
+			nextScan = now + (watcher? 30s : 1s);
 
-		if(!isC2E)
-		{
-			_mainSleep.wait_for(lock, 1s);
-		}
-		else if(isC2E)
+// engines take the lock to wake us when they close, so don't hold it while we wait on them.
+		lock.unlock();
+		engines->Update(scan);
+		lock.lock();
+
+		for(auto & item : DebugLog::GetDebugLog())
 		{
-			bool wrote = false;
-			auto response = interface->send("DBG: POLL");
-
-			if (response.isError == true)
-			{
-				fprintf(stderr, "%s\n", response.text.data());
-				continue;
-			}
-
-			if (response.text.size())
-			{
-				if (isDebugLogOpen)
-					isDebugLogOpen = !debugLog->isClosed();
-
-				size_t start = 0;
-				size_t curr = 0;
-				auto txt = response.text.data();
-
-				for (curr = response.text.find("ws", curr); curr != std::string::npos; curr = response.text.find("ws", curr))
-				{
-					auto line_end = response.text.find("\n", curr);
-
-					if (line_end == std::string::npos)
-						line_end = response.text.size() - 1;
-
-	// not a line begin
-					if (curr != 0 && response.text[curr - 1] != '\n')
-					{
-						curr = line_end;
-						continue;
-					}
-
-	// if we can't parse it it's nosie
-					if (!server->Parse(std::string_view(txt + curr, txt + line_end)))
-					{
-						curr = line_end;
-					}
-					else if (curr != 0)
-					{
-						wrote = true;
-						fprintf(stdout, "%.*s", int(curr-start), txt+start);
-						start = line_end+1;
-					}
-				}
-
-				if (start < response.text.size()-1)
-				{
-					wrote = true;
-					fprintf(stdout, "%.*s", int(response.text.size()-start), txt+start);
-				}
-			}
-
-			if(wrote)
-			{
-// TODO: if deamon open window to display stdout.
-				if (debugLog == nullptr)
-				{
-				///	debugLog = DebugLog::Open();
-				//	isDebugLogOpen = true;
-				}
-
-				fflush(stdout);
-			}
-
-			_mainSleep.wait_for(lock, 200ms);
+			fprintf(stdout, "%.*s", int(item.size()), item.data());
 		}
+
+// clients can write to the debug log while a game is open, keep printing it.
+		auto timeout = std::min<std::chrono::steady_clock::duration>(nextScan - now, engines->size()? 200ms : 30s);
+		_mainSleep.wait_for(lock, timeout, []() { return !IsRunning() || g_engineChanged; });
 	}
 
+// same again, the engines' threads and the watcher's callback both want the lock.
+	lock.unlock();
+	engines.reset();
+	watcher.reset();
+
 	server.reset();
 	ix::uninitNetSystem();
 
@@ -0,0 +1,57 @@
+#include "Caos.h"
+#include "ResponseCache.h"
+#include <cstdio>
+#include <cstdlib>
+
+static int g_failures{};
+
+#define CHECK(x) \
+	do { if(!(x)) { fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #x); ++g_failures; } } while(0)
+
+// writing to the debug log is how a script talks to websocket clients, it isn't a query.
+static void TestReadOnly()
+{
+	CHECK(Caos::IsReadOnly("outv totl 0 0 0", Caos::Dialect::C2E));
+	CHECK(Caos::IsReadOnly("outs \"x\"", Caos::Dialect::C2E));
+
+	CHECK(Caos::IsReadOnly("dbg: outs \"x\"", Caos::Dialect::C2E) == false);
+	CHECK(Caos::IsReadOnly("dbg: outv 1", Caos::Dialect::C2E) == false);
+	CHECK(Caos::IsReadOnly("dde: putv 1", Caos::Dialect::C1) == false);
+	CHECK(Caos::IsReadOnly("dde: puts [x]", Caos::Dialect::C2) == false);
+}
+
+// nothing that looks like one of these should end up in the response cache.
+static void TestErrorReply()
+{
+	CHECK(Caos::IsErrorReply(Caos::Validate("scrp 1 2 3 4", Caos::Dialect::C2E)));
+	CHECK(Caos::IsErrorReply(Caos::Validate("outs \"abc", Caos::Dialect::C2E)));
+	CHECK(Caos::IsErrorReply("### Exception: invalid command"));
+	CHECK(Caos::IsErrorReply("  Syntax error at line 1"));
+
+	CHECK(Caos::IsErrorReply("") == false);
+	CHECK(Caos::IsErrorReply("12") == false);
+	CHECK(Caos::IsErrorReply("Norn") == false);
+}
+
+// RequestScheduler only joins a request to one in flight when it has a cache key.
+static void TestFlightKey()
+{
+	CHECK(ResponseCache::GetKey("outv totl 0 0 0", Caos::Dialect::C2E).size());
+	CHECK(ResponseCache::GetKey("outv  totl 0 0 0", Caos::Dialect::C2E) == ResponseCache::GetKey("outv totl 0 0 0", Caos::Dialect::C2E));
+
+	CHECK(ResponseCache::GetKey("dbg: outs \"x\"", Caos::Dialect::C2E).empty());
+	CHECK(ResponseCache::GetKey("dbg: outv 1", Caos::Dialect::C2E).empty());
+	CHECK(ResponseCache::GetKey("dde: putv 1", Caos::Dialect::C1).empty());
+}
+
+int main()
+{
+	TestReadOnly();
+	TestErrorReply();
+	TestFlightKey();
+
+	if(g_failures)
+		fprintf(stderr, "%d failed\n", g_failures);
+
+	return g_failures? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,168 @@
+#include "Posix/PosixSMI.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+static int g_failures{};
+
+#define CHECK(x) \
+	do { if(!(x)) { fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #x); ++g_failures; } } while(0)
+
+// something listening on a loopback port we were given, so it's ours.
+static int Listen(int & port)
+{
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+	sockaddr_in address{};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if(fd < 0 || bind(fd, (sockaddr*)&address, sizeof(address)) < 0 || listen(fd, 1) < 0)
+	{
+		perror("listen");
+		exit(EXIT_FAILURE);
+	}
+
+	socklen_t length = sizeof(address);
+	getsockname(fd, (sockaddr*)&address, &length);
+	port = ntohs(address.sin_port);
+	return fd;
+}
+
+// the engine is whoever has the port open, which here is us.
+static void TestGetPid()
+{
+	int port{};
+	int fd = Listen(port);
+
+	CHECK(PosixSMI::GetPid(port) == getpid());
+	CHECK(PosixSMI::Transport::Tcp(port).GetPid() == getpid());
+
+// asked again it should come out of the cache, and be the same.
+	CHECK(PosixSMI::GetPid(port) == getpid());
+
+	if(system("command -v lsof > /dev/null 2>&1") != 0)
+		fprintf(stderr, "lsof not installed, skipping GetPidFromLsof\n");
+	else
+		CHECK(PosixSMI::GetPidFromLsof(port) == getpid());
+
+	close(fd);
+
+// nobody there any more.
+	CHECK(PosixSMI::GetPid(port) == 0);
+}
+
+// answers like the engine: reads up to rscr, replies, hangs up. the version query gets a version,
+// anything else is sent back as it came.
+static void Answer(int fd)
+{
+	std::string request;
+	char buffer[256];
+	ssize_t length;
+
+	while(request.find("\nrscr\n") == std::string::npos && (length = read(fd, buffer, sizeof(buffer))) > 0)
+		request.append(buffer, length);
+
+	auto end = request.find("\nrscr\n");
+
+	if(end != std::string::npos)
+	{
+		request.resize(end);
+		std::string reply = request.find("vmjr") != std::string::npos? "1 2 \"Fake\"" : request;
+		(void)!write(fd, reply.data(), reply.size());
+	}
+
+	close(fd);
+}
+
+// each connection gets its own thread, the warm one the pool keeps can be accepted before the one in use.
+static void FakeEngine(int listener, std::atomic<bool> & running)
+{
+	std::vector<std::thread> connections;
+
+	while(running)
+	{
+		int fd = accept(listener, nullptr, nullptr);
+
+		if(fd >= 0)
+			connections.emplace_back(Answer, fd);
+	}
+
+	for(auto & connection : connections)
+		connection.join();
+}
+
+// an engine that offers a unix socket: parse what the port file would say, connect, and send it something.
+static void TestUnixTransport()
+{
+	CHECK(PosixSMI::Transport::Parse("34013") && PosixSMI::Transport::Parse("34013")->port == 34013);
+	CHECK(PosixSMI::Transport::Parse("0") == nullptr);
+	CHECK(PosixSMI::Transport::Parse("70000") == nullptr);
+	CHECK(PosixSMI::Transport::Parse("34013x") == nullptr);
+	CHECK(PosixSMI::Transport::Parse("unix:") == nullptr);
+
+	std::string path = "/tmp/nornsockets-test-" + std::to_string(getpid()) + ".sock";
+	unlink(path.c_str());
+
+	auto transport = PosixSMI::Transport::Parse("unix:" + path);
+	CHECK(transport != nullptr);
+
+	if(transport == nullptr)
+		return;
+
+	CHECK(transport->port == 0);
+	CHECK(transport->name == "unix:" + path);
+
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if(listener < 0 || bind(listener, (sockaddr const*)&transport->address, transport->length) < 0 || listen(listener, 4) < 0)
+	{
+		perror("unix listen");
+		++g_failures;
+		return;
+	}
+
+	CHECK(transport->GetPid() == getpid());
+
+	std::atomic<bool> running{true};
+	std::thread engine(FakeEngine, listener, std::ref(running));
+
+	{
+		PosixSMI smi(*transport);
+
+		CHECK(smi._address == "unix:" + path);
+		CHECK(smi._name == "Fake");
+		CHECK(smi.versionMajor == 1 && smi.versionMinor == 2);
+
+		auto response = smi.send1252(std::string_view("outs \"hello\""));
+		CHECK(response.isError == false);
+		CHECK(response.text == "outs \"hello\"");
+		CHECK(smi.isClosed() == false);
+	}
+
+	running = false;
+	shutdown(listener, SHUT_RDWR);
+	engine.join();
+
+	close(listener);
+	unlink(path.c_str());
+}
+
+int main()
+{
+	TestGetPid();
+	TestUnixTransport();
+
+	if(g_failures)
+		fprintf(stderr, "%d failed\n", g_failures);
+
+	return g_failures? EXIT_FAILURE : EXIT_SUCCESS;
+}